@@ -0,0 +1,166 @@
+#include "SDL2_base.hpp"
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+using namespace SDL2_Base;
+
+/** Runs f once to warm up, then times iterations runs of it and prints
+ * the result as a JSON line. */
+template <typename F>
+void bench(std::string_view name, std::size_t items, int iterations, F&& f) {
+	f();
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < iterations; i++)
+		f();
+	Uint64 ticks = SDL_GetPerformanceCounter() - start;
+	double ns = static_cast<double>(ticks) * 1e9 /
+		static_cast<double>(SDL_GetPerformanceFrequency()) / iterations;
+	std::cout
+		<< "{\"name\":\"" << name << "\""
+		<< ",\"items\":" << items
+		<< ",\"iterations\":" << iterations
+		<< ",\"ns_per_iteration\":" << ns
+		<< ",\"ns_per_item\":" << ns / static_cast<double>(items)
+		<< "}\n";
+}
+
+void bench_cache() {
+	constexpr std::size_t count = 5000;
+	std::vector<std::string> paths;
+	for (std::size_t i = 0; i < count; i++)
+		paths.push_back("assets/textures/texture_" + std::to_string(i) + ".bmp");
+	TextureCache cache;
+	for (const auto& path : paths)
+		cache.intern(path);
+	std::size_t found = 0;
+	bench("cache_find", count, 200, [&]{
+		for (const auto& path : paths)
+			found += cache.find(path).has_value();
+	});
+	if (!found)
+		throw std::runtime_error("Cache lookups failed.");
+}
+
+void bench_load(Base& base, const std::string& asset) {
+	// Every "./" spelling is a distinct cache key, so each load is cold.
+	int spelling = 0;
+	auto cold_path = [&]{
+		std::string path = asset;
+		auto slash = path.rfind('/') + 1;
+		for (int i = 0; i <= spelling; i++)
+			path.insert(slash, "./");
+		spelling++;
+		return path;
+	};
+	bench("load_texture_cold", 1, 50, [&]{
+		base.load_texture(cold_path());
+	});
+	// The same cold loads serially and through preload's parallel decode.
+	constexpr std::size_t count = 64;
+	std::vector<std::string> cold_paths(count);
+	std::vector<std::string_view> cold_views(count);
+	auto next_cold_paths = [&]{
+		for (std::size_t i = 0; i < count; i++)
+			cold_views[i] = cold_paths[i] = cold_path();
+	};
+	bench("load_texture_cold_64", count, 10, [&]{
+		next_cold_paths();
+		for (auto path : cold_views)
+			base.load_texture(path);
+	});
+	bench("preload_cold_64", count, 10, [&]{
+		next_cold_paths();
+		for (auto handle : base.preload(cold_views).handles)
+			base.release_texture(handle);
+	});
+	auto id = base.intern_texture(asset);
+	bench("get_texture_warm", 1, 100000, [&]{
+		base.get_texture(id);
+	});
+}
+
+void bench_rects(Base& base, std::size_t count) {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> pos(0, 800), size(1, 32);
+	std::vector<ColorRenderArgsF> rects;
+	for (std::size_t i = 0; i < count; i++)
+		rects.push_back({
+			{pos(rng), pos(rng), size(rng), size(rng)},
+			{
+				static_cast<Uint8>(rng()), static_cast<Uint8>(rng()),
+				static_cast<Uint8>(rng()), 255
+			}
+		});
+	auto suffix = "_" + std::to_string(count);
+	bench("rects_single" + suffix, count, 10, [&]{
+		for (const auto& rect : rects)
+			base.draw(rect);
+		base.present();
+	});
+	bench("rects_batch" + suffix, count, 10, [&]{
+		base.draw(std::span<const ColorRenderArgsF>(rects));
+		base.present();
+	});
+}
+
+void bench_sprites(Base& base, const Texture& tex, std::size_t count) {
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> pos(0, 800), angle(0, 360);
+	std::vector<SDL_FRect> dsts;
+	std::vector<float> angles;
+	for (std::size_t i = 0; i < count; i++) {
+		dsts.push_back({pos(rng), pos(rng), 16, 16});
+		angles.push_back(angle(rng));
+	}
+	auto suffix = "_" + std::to_string(count);
+	bench("sprites_single" + suffix, count, 10, [&]{
+		for (std::size_t i = 0; i < count; i++)
+			base.draw(TextureRenderArgsF {
+				tex, nullptr, &dsts[i], angles[i], SDL_FLIP_NONE
+			});
+		base.present();
+	});
+	SpriteBatch batch;
+	bench("sprites_batch" + suffix, count, 10, [&]{
+		batch.clear();
+		for (std::size_t i = 0; i < count; i++)
+			batch.add(tex.get(), nullptr, dsts[i], angles[i]);
+		base.draw(batch);
+		base.present();
+	});
+}
+
+void bench_events(Base& base) {
+	bench("poll_events_empty", 1, 10000, [&]{
+		base.poll_events();
+	});
+	constexpr std::size_t count = 64;
+	bench("poll_events_64", count, 1000, [&]{
+		SDL_Event event {};
+		event.type = SDL_USEREVENT;
+		for (std::size_t i = 0; i < count; i++)
+			SDL_PushEvent(&event);
+		base.poll_events();
+	});
+}
+
+int main(int argc, char* argv[]) {
+	std::string asset = argc > 1 ? argv[1] : "../assets/face.bmp";
+	try {
+		Base base(HEADLESS, 800, 800);
+		bench_cache();
+		bench_load(base, asset);
+		auto tex = base.get_texture(asset);
+		for (std::size_t count : {1000, 10000, 100000}) {
+			bench_rects(base, count);
+			bench_sprites(base, tex, count);
+		}
+		bench_events(base);
+	} catch (const std::runtime_error& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -31,22 +31,425 @@ SOFTWARE.
 #define SDL2_BASE_HPP
 
 #include <SDL2/SDL.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <exception>
+#include <functional>
+#include <future>
+#include <latch>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <ostream>
+#include <span>
 #include <stdexcept>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <iostream>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define SDL2_BASE_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#define SDL2_BASE_HAS_INOTIFY
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SDL2_BASE_HAS_X86_SIMD
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define SDL2_BASE_HAS_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SDL2_BASE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SDL2_BASE_TARGET(isa)
+#endif
+
+#ifdef SDL2_BASE_RECORD_ERRORS
+#define SDL2_BASE_DRAW_NOEXCEPT noexcept
+#define SDL2_BASE_DRAW_ERROR(message) draw_errors.record(message)
+#define SDL2_BASE_RECORD_DRAW(...)\
+	try { __VA_ARGS__; } catch (...) { draw_errors.record("Failed to record draw."); }
+#else
+#define SDL2_BASE_DRAW_NOEXCEPT
+#define SDL2_BASE_DRAW_ERROR(message) throw std::runtime_error(message)
+#define SDL2_BASE_RECORD_DRAW(...) __VA_ARGS__
+#endif
+
+#ifdef SDL2_BASE_PROFILE
+#define SDL2_BASE_PROFILE_SCOPE(phase)\
+	ProfileScope profile_scope(profiler, phase)
+#define SDL2_BASE_PROFILE_PRESENT()\
+	PresentScope present_scope(profiler)
+#define SDL2_BASE_PROFILE_DRAW_CALL(tex)\
+	profiler.count_draw_call(tex)
+#define SDL2_BASE_PROFILE_VERTICES(count)\
+	profiler.count_vertices(count)
+#define SDL2_BASE_PROFILE_END_FRAME()\
+	profiler.end_frame()
+#else
+#define SDL2_BASE_PROFILE_SCOPE(phase)
+#define SDL2_BASE_PROFILE_PRESENT()
+#define SDL2_BASE_PROFILE_DRAW_CALL(tex)
+#define SDL2_BASE_PROFILE_VERTICES(count)
+#define SDL2_BASE_PROFILE_END_FRAME()
+#endif
+
+/** Messages below this level are compiled out: 0 trace, 1 debug, 
+ * 2 info, 3 warn, 4 error, 5 none. */
+#ifndef SDL2_BASE_LOG_LEVEL
 #ifndef NDEBUG
-#define DBGMSG(message)\
-	std::cout << "[SDL2_BASE_DEBUG]: " << message << "\n";
+#define SDL2_BASE_LOG_LEVEL 1
 #else
-#define DBGMSG(message)
+#define SDL2_BASE_LOG_LEVEL 5
+#endif
+#endif
+
+#define SDL2_BASE_LOG(level, ...)\
+	do {\
+		static SDL2_Base::LogSite sdl2_base_log_site {level};\
+		SDL2_Base::Logger::get().log(sdl2_base_log_site, __VA_ARGS__);\
+	} while (0)
+
+#if SDL2_BASE_LOG_LEVEL <= 0
+#define SDL2_BASE_LOG_TRACE(...) SDL2_BASE_LOG(SDL2_Base::LOG_TRACE, __VA_ARGS__)
+#else
+#define SDL2_BASE_LOG_TRACE(...) ((void)0)
+#endif
+#if SDL2_BASE_LOG_LEVEL <= 1
+#define SDL2_BASE_LOG_DEBUG(...) SDL2_BASE_LOG(SDL2_Base::LOG_DEBUG, __VA_ARGS__)
+#else
+#define SDL2_BASE_LOG_DEBUG(...) ((void)0)
+#endif
+#if SDL2_BASE_LOG_LEVEL <= 2
+#define SDL2_BASE_LOG_INFO(...) SDL2_BASE_LOG(SDL2_Base::LOG_INFO, __VA_ARGS__)
+#else
+#define SDL2_BASE_LOG_INFO(...) ((void)0)
+#endif
+#if SDL2_BASE_LOG_LEVEL <= 3
+#define SDL2_BASE_LOG_WARN(...) SDL2_BASE_LOG(SDL2_Base::LOG_WARN, __VA_ARGS__)
+#else
+#define SDL2_BASE_LOG_WARN(...) ((void)0)
+#endif
+#if SDL2_BASE_LOG_LEVEL <= 4
+#define SDL2_BASE_LOG_ERROR(...) SDL2_BASE_LOG(SDL2_Base::LOG_ERROR, __VA_ARGS__)
+#else
+#define SDL2_BASE_LOG_ERROR(...) ((void)0)
 #endif
 
 namespace SDL2_Base {
 
+	// Logging
+
+	enum LogLevel {
+		LOG_TRACE,
+		LOG_DEBUG,
+		LOG_INFO,
+		LOG_WARN,
+		LOG_ERROR,
+		LOG_OFF
+	};
+
+	/** State of a logging call site, used to rate limit repeated
+	 * messages. */
+	struct LogSite {
+		LogLevel level;
+		std::atomic<Uint64> second {0};
+		std::atomic<Uint32> count {0};
+		std::atomic<Uint32> suppressed {0};
+	};
+
+	/** Asynchronous logger behind the SDL2_BASE_LOG_* macros. 
+	 * Producers copy the format and its arguments into a lock-free ring 
+	 * buffer; a background thread formats and writes them. Messages 
+	 * beyond rate_limit per second per call site, or beyond the ring's
+	 * capacity, are dropped and reported as a count. */
+	class Logger {
+
+		public:
+
+		/** Messages a call site may log per second. */
+		static constexpr Uint32 rate_limit = 16;
+		static constexpr std::size_t capacity = 1024;
+		static constexpr std::size_t max_args = 6;
+		using Sink = std::function<void(LogLevel, std::string_view)>;
+
+		private:
+
+		enum ArgType : Uint8 {
+			ARG_INT,
+			ARG_UINT,
+			ARG_DOUBLE,
+			ARG_BOOL,
+			ARG_POINTER,
+			ARG_STRING
+		};
+
+		struct Arg {
+			ArgType type;
+			union {
+				long long i;
+				unsigned long long u;
+				double d;
+				const void* p;
+				/** Offset and size of a string in the record's text. */
+				struct { Uint16 offset, size; } s;
+			};
+		};
+
+		struct Record {
+			const LogSite* site;
+			const char* format;
+			Uint32 suppressed;
+			Uint8 arg_count;
+			Uint16 text_size;
+			Arg args[max_args];
+			char text[160];
+		};
+
+		struct Slot {
+			std::atomic<std::size_t> sequence;
+			Record record;
+		};
+
+		std::unique_ptr<Slot[]> slots {new Slot[capacity]};
+		alignas(64) std::atomic<std::size_t> head {0};
+		alignas(64) std::size_t tail {0};
+		std::atomic<Uint32> dropped {0};
+		std::mutex consumer_mutex;
+		std::mutex sink_mutex;
+		Sink sink;
+		std::atomic<bool> running {true};
+		std::thread flusher;
+
+		Logger() {
+			for (std::size_t i = 0; i < capacity; i++)
+				slots[i].sequence.store(i, std::memory_order_relaxed);
+			flusher = std::thread([this]{
+				while (running.load(std::memory_order_acquire)) {
+					if (!flush())
+						std::this_thread::sleep_for(std::chrono::milliseconds(5));
+				}
+				flush();
+			});
+		}
+
+		/** Returns whether the call site is within its rate limit and
+		 * collects the messages it suppressed in earlier seconds. */
+		static bool admit(LogSite& site, Uint32& suppressed) {
+			auto second = static_cast<Uint64>(
+				std::chrono::duration_cast<std::chrono::seconds>(
+					std::chrono::steady_clock::now().time_since_epoch()).count());
+			if (site.second.load(std::memory_order_relaxed) != second) {
+				site.second.store(second, std::memory_order_relaxed);
+				site.count.store(0, std::memory_order_relaxed);
+				suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+			}
+			if (site.count.fetch_add(1, std::memory_order_relaxed) < rate_limit)
+				return true;
+			site.suppressed.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		template <typename T>
+		static void store(Record& record, const T& value) {
+			using U = std::decay_t<T>;
+			Arg& arg = record.args[record.arg_count++];
+			if constexpr (std::is_same_v<U, bool>) {
+				arg.type = ARG_BOOL;
+				arg.u = value;
+			} else if constexpr (std::is_enum_v<U>) {
+				arg.type = ARG_INT;
+				arg.i = static_cast<long long>(value);
+			} else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+				arg.type = ARG_INT;
+				arg.i = value;
+			} else if constexpr (std::is_integral_v<U>) {
+				arg.type = ARG_UINT;
+				arg.u = value;
+			} else if constexpr (std::is_floating_point_v<U>) {
+				arg.type = ARG_DOUBLE;
+				arg.d = value;
+			} else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+				std::string_view str = value;
+				auto size = std::min(str.size(), sizeof(record.text) - record.text_size);
+				std::memcpy(record.text + record.text_size, str.data(), size);
+				arg.type = ARG_STRING;
+				arg.s = {record.text_size, static_cast<Uint16>(size)};
+				record.text_size = static_cast<Uint16>(record.text_size + size);
+			} else if constexpr (std::is_pointer_v<U>) {
+				arg.type = ARG_POINTER;
+				arg.p = value;
+			} else {
+				static_assert(sizeof(T) == 0, "Unsupported log argument type.");
+			}
+		}
+
+		static void append(std::string& out, const Record& record, const Arg& arg) {
+			char buf[32];
+			std::to_chars_result result {buf, {}};
+			switch (arg.type) {
+				case ARG_INT: result = std::to_chars(buf, buf + sizeof(buf), arg.i); break;
+				case ARG_UINT: result = std::to_chars(buf, buf + sizeof(buf), arg.u); break;
+				case ARG_DOUBLE: result = std::to_chars(buf, buf + sizeof(buf), arg.d); break;
+				case ARG_BOOL: out += arg.u ? "true" : "false"; return;
+				case ARG_POINTER:
+					out += "0x";
+					result = std::to_chars(buf, buf + sizeof(buf),
+						reinterpret_cast<std::uintptr_t>(arg.p), 16);
+					break;
+				case ARG_STRING: out.append(record.text + arg.s.offset, arg.s.size); return;
+			}
+			out.append(buf, result.ptr);
+		}
+
+		static void format(std::string& out, const Record& record) {
+			std::size_t next = 0;
+			for (const char* c = record.format; *c; c++) {
+				if (c[0] == '{' && c[1] == '}' && next < record.arg_count) {
+					append(out, record, record.args[next++]);
+					c++;
+				} else {
+					out += *c;
+				}
+			}
+			if (record.suppressed) {
+				out += " (";
+				append(out, record, {ARG_UINT, {.u = record.suppressed}});
+				out += " similar messages suppressed)";
+			}
+		}
+
+		void write(LogLevel level, std::string_view message) {
+			std::lock_guard lock(sink_mutex);
+			if (sink) {
+				sink(level, message);
+				return;
+			}
+			static constexpr const char* names[] {
+				"TRACE", "DEBUG", "INFO", "WARN", "ERROR"
+			};
+			std::cout << "[SDL2_BASE_" << names[level] << "]: " << message << "\n";
+		}
+
+		public:
+
+		Logger(const Logger&) = delete;
+		Logger& operator=(const Logger&) = delete;
+
+		~Logger() {
+			running.store(false, std::memory_order_release);
+			flusher.join();
+		}
+
+		/** Returns the logger, starting its thread on the first call. */
+		static Logger& get() {
+			static Logger logger;
+			return logger;
+		}
+
+		/** Queues a message. Doesn't block or allocate.
+		 * @param site The call site.
+		 * @param format The message, with {} replaced by the arguments in
+		 * order. Must be a string literal since it's formatted later.
+		 * @param args Numbers, pointers or strings, which are copied. */
+		template <typename... Args>
+		void log(LogSite& site, const char* format, const Args&... args) {
+			static_assert(sizeof...(Args) <= max_args, "Too many log arguments.");
+			Uint32 suppressed = 0;
+			if (!admit(site, suppressed))
+				return;
+			std::size_t pos = head.load(std::memory_order_relaxed);
+			Slot* slot;
+			for (;;) {
+				slot = &slots[pos % capacity];
+				std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+				if (sequence == pos) {
+					if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				} else if (sequence < pos) {
+					dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				} else {
+					pos = head.load(std::memory_order_relaxed);
+				}
+			}
+			Record& record = slot->record;
+			record.site = &site;
+			record.format = format;
+			record.suppressed = suppressed;
+			record.arg_count = 0;
+			record.text_size = 0;
+			(store(record, args), ...);
+			slot->sequence.store(pos + 1, std::memory_order_release);
+		}
+
+		/** Formats and writes all queued messages.
+		 * @return Whether there were any. */
+		bool flush() {
+			std::lock_guard lock(consumer_mutex);
+			std::string message;
+			bool any = false;
+			for (;;) {
+				Slot& slot = slots[tail % capacity];
+				if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+					break;
+				message.clear();
+				format(message, slot.record);
+				LogLevel level = slot.record.site->level;
+				slot.sequence.store(tail + capacity, std::memory_order_release);
+				tail++;
+				write(level, message);
+				any = true;
+			}
+			if (Uint32 count = dropped.exchange(0, std::memory_order_relaxed)) {
+				message = std::to_string(count) + " messages dropped, log buffer full.";
+				write(LOG_WARN, message);
+			}
+			return any;
+		}
+
+		/** Replaces the default output to std::cout. The sink is called 
+		 * from the logger's thread.
+		 * @param sink The sink or nullptr for std::cout. */
+		void set_sink(Sink sink) {
+			std::lock_guard lock(sink_mutex);
+			this->sink = std::move(sink);
+		}
+	};
+
 	// Custom types
 
 	using Window =std::unique_ptr<SDL_Window, void(*)(SDL_Window*)>;
@@ -82,6 +485,159 @@ namespace SDL2_Base {
 		SDL_RendererFlip flip;
 	};
 
+	/** Trivially copyable reference to a texture in Base's cache, 
+	 * obtained from Base::acquire_texture. The texture stays resident 
+	 * until the handle is released. The generation tells a handle to an 
+	 * evicted texture apart from one to its reload, which debug builds 
+	 * check on every use. */
+	struct TextureHandle {
+		Uint32 index;
+		Uint32 generation;
+	};
+
+	/** Sprite drawn from a TextureHandle, without reference counting. */
+	struct HandleRenderArgsF {
+		TextureHandle tex;
+		const SDL_Rect* srcrect;
+		const SDL_FRect* dstrect;
+		float angle;
+		SDL_RendererFlip flip;
+	};
+
+	/** A rectangular part of a (possibly shared atlas) texture. */
+	struct TextureRegion {
+		Texture tex;
+		SDL_Rect src;
+	};
+
+	/** Index of an interned path in the TextureCache. */
+	using TextureId = Uint32;
+
+	/** Occupancy information of the texture atlas. */
+	struct AtlasStats {
+		std::size_t pages;
+		std::size_t regions;
+		/** Ratio of the area covered by regions to the total page area. */
+		double occupancy;
+	};
+
+	/** Phases of a frame measured by the Profiler. */
+	enum Phase {
+		CLEAR,
+		DRAW,
+		PRESENT,
+		POLL_EVENTS,
+		PHASE_COUNT
+	};
+
+	/** Measurements of a single frame in performance counter ticks. */
+	struct FrameStats {
+		Uint64 start;
+		Uint64 frame_ticks;
+		/** Total time spent in each phase. */
+		Uint64 phase_ticks[PHASE_COUNT];
+		/** First entry into each phase, 0 if it wasn't entered. */
+		Uint64 phase_start[PHASE_COUNT];
+		/** Time SDL_RenderPresent blocked. */
+		Uint64 present_ticks;
+		Uint32 draw_calls;
+		Uint32 texture_binds;
+		/** Vertices submitted through SDL_RenderGeometry. */
+		Uint32 vertices;
+	};
+
+	/** Result of Base::preload. */
+	struct PreloadResult {
+		/** A handle per requested bmp in the order of the request. */
+		std::vector<TextureHandle> handles;
+		/** Number of textures that had to be loaded. */
+		std::size_t loaded;
+		/** Size of the loaded textures in bytes. */
+		std::size_t bytes;
+		/** Time the preload took in ms. */
+		double ms;
+	};
+
+	/** Statistics of a measurement over a number of frames in ms. */
+	struct Summary {
+		double min;
+		double avg;
+		double p99;
+	};
+
+	/** Renderer load of the most recent frames from the Profiler. */
+	struct RenderStats {
+		/** Averages per frame. */
+		double draw_calls;
+		double vertices;
+		double texture_switches;
+		/** CPU time of whole frames. */
+		Summary frame;
+		/** Time SDL_RenderPresent blocked. */
+		Summary present;
+	};
+
+	/** Callback invoked for each dispatched event of a type. */
+	using EventHandler = std::function<void(const SDL_Event&)>;
+
+	/** Configuration of the Base::run main loop. */
+	struct LoopConfig {
+		/** Length of a simulation step in seconds. */
+		double timestep {1.0 / 60.0};
+		/** Maximum simulation steps per frame. Time beyond that is 
+		 * dropped so slow frames can't snowball into slower ones. */
+		int max_steps {5};
+		/** Frame rate limit used when vsync is off, 0 for no limit. */
+		double max_fps {0};
+	};
+
+	/** Configuration of the adaptive quality of Base. */
+	struct QualityConfig {
+		/** Frame time budget in ms. */
+		double budget_ms {1000.0 / 60.0};
+		/** Quality is lowered when the p95 frame time of a window 
+		 * exceeds budget_ms times this. */
+		double lower_above {0.9};
+		/** Quality is raised when the p95 frame time stays below 
+		 * budget_ms times this for raise_after windows. */
+		double raise_below {0.7};
+		int raise_after {3};
+		/** Frames per window. */
+		std::size_t window {60};
+		/** Change of quality per adjustment. */
+		float step {0.125f};
+		float min_quality {0.5f};
+	};
+
+	/** Errors recorded instead of thrown by the drawing functions when
+	 * compiled with SDL2_BASE_RECORD_ERRORS. */
+	struct DrawErrors {
+		Uint32 count;
+		/** The message of the most recent error or nullptr. 
+		 * SDL_GetError has the details. */
+		const char* last;
+
+		void record(const char* message) noexcept {
+			count++;
+			last = message;
+		}
+	};
+
+	/** Pixel processing applied to bmps as they are loaded. 
+	 * Textures that are already resident are not affected. */
+	struct LoadConfig {
+		/** Pixels of this color become fully transparent. */
+		std::optional<SDL_Color> color_key;
+		/** Multiplies colors by alpha and draws with a matching blend 
+		 * mode, so scaled sprites don't get dark fringes. */
+		bool premultiply_alpha {false};
+	};
+
+	/** Selects the headless constructor of Base. */
+	enum Headless {
+		HEADLESS
+	};
+
 	enum State {
 		QUITTING,
 		RUNNING
@@ -115,162 +671,4117 @@ namespace SDL2_Base {
 		}
 	};
 
-	// Main class
+	/** Finalizer of the splitmix64 generator, which spreads every input
+	 * bit over the whole result. */
+	inline Uint64 mix_hash(Uint64 v) {
+		v = (v ^ (v >> 30)) * 0xBF58476D1CE4E5B9ull;
+		v = (v ^ (v >> 27)) * 0x94D049BB133111EBull;
+		return v ^ (v >> 31);
+	}
+}
 
-	/** Class store and manage SDL2_Base resources. */
-	class Base {
+template <>
+struct std::hash<SDL2_Base::Coordinates> {
+	std::size_t operator()(const SDL2_Base::Coordinates& c) const noexcept {
+		return static_cast<std::size_t>(SDL2_Base::mix_hash(
+			Uint64(static_cast<Uint32>(c.x)) << 32 | static_cast<Uint32>(c.y)));
+	}
+};
+
+template <>
+struct std::hash<SDL2_Base::CoordinatesF> {
+	std::size_t operator()(const SDL2_Base::CoordinatesF& c) const noexcept {
+		// Adding 0 turns -0 into 0, which compares equal to it.
+		float x = c.x + 0.0f, y = c.y + 0.0f;
+		Uint32 bx, by;
+		std::memcpy(&bx, &x, sizeof(bx));
+		std::memcpy(&by, &y, sizeof(by));
+		return static_cast<std::size_t>(SDL2_Base::mix_hash(Uint64(bx) << 32 | by));
+	}
+};
+
+namespace SDL2_Base {
+
+	/** A set of keys as a bitmask of scancodes. */
+	using KeySet = std::bitset<SDL_NUM_SCANCODES>;
+
+	/** Keyboard and mouse state captured once per frame, with the 
+	 * previous frame's state kept for edge detection. */
+	class Input {
 
 		private:
 
-		/** Class to manage the SDL2 session. */
-		class SDL {
+		KeySet current, previous;
+		Uint32 buttons {0}, previous_buttons {0};
+		Coordinates mouse {0, 0};
+		CoordinatesF wheel {0, 0};
 
-			private:
-			
-			Uint32 flags;
-			
-			public:
+		public:
 
-			/** Constructor of the SDL class.
-			 * @param flags SDL init flags.
-			 * @throws std::runtime_error on failure. */
-			SDL(Uint32 flags) : flags(flags) {
-				if (SDL_Init(flags))
-					throw std::runtime_error("Failed to init SDL.");
-				DBGMSG("SDL2 initialized.");
+		/** Captures the current state and starts a new frame. Called by
+		 * Base::poll_events after pumping the events. */
+		void update() {
+			previous = current;
+			previous_buttons = buttons;
+			int count;
+			const Uint8* keys = SDL_GetKeyboardState(&count);
+			for (int i = 0; i < count && i < SDL_NUM_SCANCODES; i++)
+				current.set(static_cast<std::size_t>(i), keys[i]);
+			buttons = SDL_GetMouseState(&mouse.x, &mouse.y);
+			wheel = {0, 0};
+		}
+
+		/** Accumulates the scrolling of a mouse wheel event.
+		 * @param e The event. */
+		void add_wheel(const SDL_MouseWheelEvent& e) {
+			wheel.x += e.preciseX;
+			wheel.y += e.preciseY;
+		}
+
+		/** Checks if a key is held down. */
+		bool is_down(SDL_Scancode key) const {
+			return current[key];
+		}
+
+		/** Checks if a key went down this frame. */
+		bool was_pressed(SDL_Scancode key) const {
+			return current[key] && !previous[key];
+		}
+
+		/** Checks if a key went up this frame. */
+		bool was_released(SDL_Scancode key) const {
+			return !current[key] && previous[key];
+		}
+
+		/** Checks if any of the keys is held down. */
+		bool any_down(const KeySet& keys) const {
+			return (current & keys).any();
+		}
+
+		/** Checks if all of the keys are held down. */
+		bool all_down(const KeySet& keys) const {
+			return (current & keys) == keys;
+		}
+
+		/** Returns the keys held down. */
+		const KeySet& get_down() const {
+			return current;
+		}
+
+		/** Returns the keys that went down this frame. */
+		KeySet get_pressed() const {
+			return current & ~previous;
+		}
+
+		/** Returns the keys that went up this frame. */
+		KeySet get_released() const {
+			return previous & ~current;
+		}
+
+		/** Checks if a mouse button (SDL_BUTTON_LEFT etc.) is held down. */
+		bool is_button_down(int button) const {
+			return buttons & SDL_BUTTON(button);
+		}
+
+		/** Checks if a mouse button went down this frame. */
+		bool was_button_pressed(int button) const {
+			return (buttons & ~previous_buttons) & SDL_BUTTON(button);
+		}
+
+		/** Checks if a mouse button went up this frame. */
+		bool was_button_released(int button) const {
+			return (previous_buttons & ~buttons) & SDL_BUTTON(button);
+		}
+
+		/** Returns the mouse position relative to the focused window. */
+		Coordinates get_mouse_position() const {
+			return mouse;
+		}
+
+		/** Returns the wheel scrolling accumulated this frame. */
+		CoordinatesF get_wheel() const {
+			return wheel;
+		}
+	};
+
+	/** Reusable vertex and index storage for SDL_RenderGeometry.
+	 * Clearing keeps the capacity so per-frame batches don't reallocate. */
+	struct Geometry {
+		std::vector<SDL_Vertex> vertices;
+		std::vector<int> indices;
+
+		/** Removes all vertices and indices but keeps the capacity. */
+		void clear() {
+			vertices.clear();
+			indices.clear();
+		}
+
+		/** Computes the vertices of an untextured, axis aligned rectangle.
+		 * @param quad Receives the corners in top left, top right, 
+		 * bottom right, bottom left order.
+		 * @param rect The rectangle.
+		 * @param col The fill color. */
+		static void rect_quad(
+			SDL_Vertex (&quad)[4],
+			const SDL_FRect& rect,
+			SDL_Color col
+		) {
+			float x1 = rect.x + rect.w;
+			float y1 = rect.y + rect.h;
+			quad[0] = {{rect.x, rect.y}, col, {0, 0}};
+			quad[1] = {{x1, rect.y}, col, {0, 0}};
+			quad[2] = {{x1, y1}, col, {0, 0}};
+			quad[3] = {{rect.x, y1}, col, {0, 0}};
+		}
+
+		/** Computes the vertices of a sprite the way SDL_RenderCopyEx
+		 * would draw it.
+		 * @param quad Receives the corners in top left, top right, 
+		 * bottom right, bottom left order.
+		 * @param tex_w The width of the texture.
+		 * @param tex_h The height of the texture.
+		 * @param srcrect The source rectangle or nullptr for the whole texture.
+		 * @param dstrect The destination rectangle.
+		 * @param angle Clockwise rotation around the center of dstrect 
+		 * in degrees.
+		 * @param flip Flipping of the sprite.
+		 * @param col Color modulation of the sprite. */
+		static void sprite_quad(
+			SDL_Vertex (&quad)[4],
+			int tex_w, int tex_h,
+			const SDL_Rect* srcrect,
+			const SDL_FRect& dstrect,
+			float angle,
+			SDL_RendererFlip flip,
+			SDL_Color col
+		) {
+			float tw = static_cast<float>(tex_w);
+			float th = static_cast<float>(tex_h);
+			SDL_FRect src = srcrect ?
+				SDL_FRect {
+					static_cast<float>(srcrect->x),
+					static_cast<float>(srcrect->y),
+					static_cast<float>(srcrect->w),
+					static_cast<float>(srcrect->h)
+				} :
+				SDL_FRect {0, 0, tw, th};
+			float u0 = src.x / tw, u1 = (src.x + src.w) / tw;
+			float v0 = src.y / th, v1 = (src.y + src.h) / th;
+			if (flip & SDL_FLIP_HORIZONTAL)
+				std::swap(u0, u1);
+			if (flip & SDL_FLIP_VERTICAL)
+				std::swap(v0, v1);
+
+			float hw = dstrect.w / 2, hh = dstrect.h / 2;
+			float cx = dstrect.x + hw, cy = dstrect.y + hh;
+			SDL_FPoint pos[4] {{-hw, -hh}, {hw, -hh}, {hw, hh}, {-hw, hh}};
+			SDL_FPoint uv[4] {{u0, v0}, {u1, v0}, {u1, v1}, {u0, v1}};
+			float c = 1, s = 0;
+			if (angle != 0) {
+				float rad = angle * static_cast<float>(M_PI) / 180.0f;
+				c = std::cos(rad);
+				s = std::sin(rad);
+			}
+			for (int i = 0; i < 4; i++) {
+				SDL_FPoint p = pos[i];
+				quad[i] = {{cx + p.x * c - p.y * s, cy + p.x * s + p.y * c}, col, uv[i]};
 			}
+		}
 
-			~SDL() {
-				if (SDL_WasInit(flags) == flags)
-					SDL_Quit();
-				DBGMSG("SDL2 terminated.");
+		/** Appends a quad as two triangles.
+		 * @param quad Corners in top left, top right, bottom right, 
+		 * bottom left order. */
+		void push_quad(const SDL_Vertex (&quad)[4]) {
+			int first = static_cast<int>(vertices.size());
+			vertices.insert(vertices.end(), quad, quad + 4);
+			indices.insert(indices.end(), {
+				first, first + 1, first + 2,
+				first, first + 2, first + 3
+			});
+		}
+
+		/** Appends quads as two triangles each, leaving their vertices
+		 * to be written by the caller.
+		 * @param count The number of quads.
+		 * @return The 4 vertices per quad, corners in top left, top 
+		 * right, bottom right, bottom left order. */
+		std::span<SDL_Vertex> append_quads(std::size_t count) {
+			std::size_t first = vertices.size();
+			vertices.resize(first + count * 4);
+			indices.reserve(indices.size() + count * 6);
+			for (std::size_t i = 0; i < count; i++) {
+				int v = static_cast<int>(first + i * 4);
+				indices.insert(indices.end(), {v, v + 1, v + 2, v, v + 2, v + 3});
 			}
+			return std::span(vertices).subspan(first);
+		}
+
+		/** Appends an untextured, axis aligned rectangle.
+		 * @param rect The rectangle.
+		 * @param col The fill color. */
+		void push_rect(const SDL_FRect& rect, SDL_Color col) {
+			SDL_Vertex quad[4];
+			rect_quad(quad, rect, col);
+			push_quad(quad);
+		}
+	};
 
+	/** Accumulates textured quads and groups consecutive quads sharing the
+	 * same texture into runs, each of which is drawn with a single
+	 * SDL_RenderGeometry call by Base::draw(const SpriteBatch&).
+	 * Rotation and flipping are applied on the CPU when a sprite is added.
+	 * The batch stores raw texture pointers, so the textures have to 
+	 * outlive the batch's contents. */
+	class SpriteBatch {
+
+		public:
+
+		/** A range of indices drawn with the same texture. */
+		struct Run {
+			SDL_Texture* tex;
+			int tex_w, tex_h;
+			std::size_t first_index;
+			std::size_t index_count;
 		};
 
-		// Variables
+		private:
 
-		SDL sdl;
-		Window win;
-		Renderer ren;
-		[[maybe_unused]] SDL_Event event;
-		[[maybe_unused]] State state {RUNNING};
-		std::map<std::string, Texture> textures_map;
+		Geometry geometry;
+		std::vector<Run> runs;
 
 		public:
 
-		/** Constructor of the Base class.
-		 * @param init_flags SDL2 init flag(s) separated by '|'.
-		 * @param title The window title. 
-		 * @param w The width of the window.
-		 * @param h the height of the window.
-		 * @param win_flags SDL2 window flag(s) separated by '|'.
-		 * @param ren_flags SDL2 renderer flag(s) separated by '|'.
+		/** Adds a sprite to the batch.
+		 * @param tex The texture to sample from.
+		 * @param srcrect The source rectangle or nullptr for the whole texture.
+		 * @param dstrect The destination rectangle.
+		 * @param angle Clockwise rotation around the center of dstrect 
+		 * in degrees.
+		 * @param flip Flipping of the sprite.
+		 * @param col Color modulation of the sprite.
 		 * @throws std::runtime_error on failure. */
-		Base(
-			Uint32 init_flags,
-			std::string_view title,
-			int w, int h,
-			Uint32 win_flags,
-			Uint32 ren_flags
-		) :
-			sdl(init_flags),
-			win(
-				[&]() {
-					auto wi =
-						SDL_CreateWindow(title.data(), 0, 0, w, h, win_flags);
-					if (!wi)
-						throw std::runtime_error("Failed to create window.");
-					DBGMSG("Window created.");
-					return wi;
+		void add(
+			SDL_Texture* tex,
+			const SDL_Rect* srcrect,
+			const SDL_FRect& dstrect,
+			float angle = 0,
+			SDL_RendererFlip flip = SDL_FLIP_NONE,
+			SDL_Color col = {255, 255, 255, 255}
+		) {
+			if (runs.empty() || runs.back().tex != tex) {
+				Run run {tex, 0, 0, geometry.indices.size(), 0};
+				if (SDL_QueryTexture(tex, nullptr, nullptr, &run.tex_w, &run.tex_h))
+					throw std::runtime_error("Failed to query texture.");
+				runs.push_back(run);
+			}
+			Run& run = runs.back();
+			SDL_Vertex quad[4];
+			Geometry::sprite_quad(
+				quad, run.tex_w, run.tex_h, srcrect, dstrect, angle, flip, col);
+			geometry.push_quad(quad);
+			run.index_count += 6;
+		}
+
+		/** Adds a sprite sampled from a texture region.
+		 * @param region The region to sample from.
+		 * @param dstrect The destination rectangle.
+		 * @param angle Clockwise rotation in degrees.
+		 * @param flip Flipping of the sprite.
+		 * @param col Color modulation of the sprite.
+		 * @throws std::runtime_error on failure. */
+		void add(
+			const TextureRegion& region,
+			const SDL_FRect& dstrect,
+			float angle = 0,
+			SDL_RendererFlip flip = SDL_FLIP_NONE,
+			SDL_Color col = {255, 255, 255, 255}
+		) {
+			add(region.tex.get(), &region.src, dstrect, angle, flip, col);
+		}
+
+		/** Adds a sprite to the batch. The texture is not copied.
+		 * @param args Struct containing the rendering arguments.
+		 * @throws std::runtime_error on failure. */
+		void add(const TextureRenderArgs& args) {
+			SDL_FRect dst {0, 0, 0, 0};
+			if (args.dstrect) {
+				dst = {
+					static_cast<float>(args.dstrect->x),
+					static_cast<float>(args.dstrect->y),
+					static_cast<float>(args.dstrect->w),
+					static_cast<float>(args.dstrect->h)
+				};
+			}
+			add(args.tex.get(), args.srcrect, dst, args.angle, args.flip);
+		}
+
+		/** Adds a sprite to the batch (float). The texture is not copied.
+		 * @param args Struct containing the rendering arguments.
+		 * @throws std::runtime_error on failure. */
+		void add(const TextureRenderArgsF& args) {
+			SDL_FRect dst = args.dstrect ? *args.dstrect : SDL_FRect {0, 0, 0, 0};
+			add(args.tex.get(), args.srcrect, dst, args.angle, args.flip);
+		}
+
+		/** Appends quads sampled from a texture, leaving their vertices
+		 * to be written by the caller. The uvs are normalized.
+		 * @param tex The texture to sample from.
+		 * @param count The number of quads.
+		 * @return The 4 vertices per quad, as in Geometry::append_quads.
+		 * @throws std::runtime_error on failure. */
+		std::span<SDL_Vertex> add_quads(SDL_Texture* tex, std::size_t count) {
+			if (runs.empty() || runs.back().tex != tex) {
+				Run run {tex, 0, 0, geometry.indices.size(), 0};
+				if (SDL_QueryTexture(tex, nullptr, nullptr, &run.tex_w, &run.tex_h))
+					throw std::runtime_error("Failed to query texture.");
+				runs.push_back(run);
+			}
+			runs.back().index_count += count * 6;
+			return geometry.append_quads(count);
+		}
+
+		/** Removes all sprites but keeps the allocated memory. */
+		void clear() {
+			geometry.clear();
+			runs.clear();
+		}
+
+		/** Checks if the batch is empty.
+		 * @return A boolean indicating the result. */
+		bool empty() const {
+			return runs.empty();
+		}
+
+		/** Returns the accumulated geometry. */
+		const Geometry& get_geometry() const {
+			return geometry;
+		}
+
+		/** Returns the texture runs in submission order. */
+		std::span<const Run> get_runs() const {
+			return runs;
+		}
+	};
+
+	/** Initial state of a particle emitted into a ParticleSystem. */
+	struct Particle {
+		CoordinatesF position;
+		/** Movement per second. */
+		CoordinatesF velocity {0, 0};
+		CoordinatesF size {1, 1};
+		/** Color modulation; the alpha is the initial opacity. */
+		SDL_Color color {255, 255, 255, 255};
+		/** Opacity lost per second, the particle dies at 0. */
+		float fade {1};
+		/** Clockwise rotation around the center in degrees. */
+		float angle {0};
+		/** Rotation per second in degrees. */
+		float spin {0};
+		/** Normalized texture coordinates of the sprite. */
+		SDL_FRect uv {0, 0, 1, 1};
+	};
+
+	/** Particles stored as a structure of arrays, so that updating them
+	 * runs SIMD kernels over contiguous floats, and written straight 
+	 * into the vertices of a Geometry or SpriteBatch for drawing. 
+	 * Dead particles are compacted away in update, keeping the order 
+	 * of the living ones. */
+	class ParticleSystem {
+
+		private:
+
+		std::vector<float> x, y, vx, vy, w, h, angle, spin, alpha, fade;
+		std::vector<float> u0, v0, u1, v1;
+		std::vector<SDL_Color> color;
+		/** Scratch space of update, which only ever grows. */
+		std::vector<Uint8> keep;
+		std::size_t limit {SIZE_MAX};
+
+		template <typename F>
+		void for_each_field(F&& f) {
+			for (auto* field : {&x, &y, &vx, &vy, &w, &h, &angle, &spin,
+				&alpha, &fade, &u0, &v0, &u1, &v1})
+				f(*field);
+			f(color);
+		}
+
+		/** Computes y[i] += a * x[i]. */
+		static void axpy(float* y, const float* x, float a, std::size_t count) {
+			std::size_t i = 0;
+#if defined(SDL2_BASE_HAS_X86_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+			const __m128 va = _mm_set1_ps(a);
+			for (; i + 4 <= count; i += 4)
+				_mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i),
+					_mm_mul_ps(_mm_loadu_ps(x + i), va)));
+#elif defined(SDL2_BASE_HAS_NEON)
+			const float32x4_t va = vdupq_n_f32(a);
+			for (; i + 4 <= count; i += 4)
+				vst1q_f32(y + i, vmlaq_f32(vld1q_f32(y + i), vld1q_f32(x + i), va));
+#endif
+			for (; i < count; i++)
+				y[i] += a * x[i];
+		}
+
+		/** Returns the index of the first particle with no opacity left
+		 * or the count. */
+		std::size_t first_dead() const {
+			std::size_t i = 0, count = alpha.size();
+#if defined(SDL2_BASE_HAS_X86_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+			const __m128 zero = _mm_setzero_ps();
+			for (; i + 4 <= count; i += 4)
+				if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(&alpha[i]), zero)))
+					break;
+#endif
+			while (i < count && alpha[i] > 0)
+				i++;
+			return i;
+		}
+
+		public:
+
+		/** Adds a particle unless the limit is reached. */
+		void emit(const Particle& p) {
+			if (size() >= limit)
+				return;
+			x.push_back(p.position.x);
+			y.push_back(p.position.y);
+			vx.push_back(p.velocity.x);
+			vy.push_back(p.velocity.y);
+			w.push_back(p.size.x);
+			h.push_back(p.size.y);
+			angle.push_back(p.angle);
+			spin.push_back(p.spin);
+			alpha.push_back(p.color.a / 255.0f);
+			fade.push_back(p.fade);
+			u0.push_back(p.uv.x);
+			v0.push_back(p.uv.y);
+			u1.push_back(p.uv.x + p.uv.w);
+			v1.push_back(p.uv.y + p.uv.h);
+			color.push_back(p.color);
+		}
+
+		/** Advances the particles and removes the ones that faded out.
+		 * @param dt The elapsed time in seconds. */
+		void update(float dt) {
+			std::size_t count = size();
+			axpy(x.data(), vx.data(), dt, count);
+			axpy(y.data(), vy.data(), dt, count);
+			axpy(angle.data(), spin.data(), dt, count);
+			axpy(alpha.data(), fade.data(), -dt, count);
+
+			std::size_t dead = first_dead();
+			if (dead == count)
+				return;
+			if (keep.size() < count - dead)
+				keep.resize(count - dead);
+			std::size_t kept = dead;
+			for (std::size_t i = dead; i < count; i++)
+				kept += keep[i - dead] = alpha[i] > 0;
+			for_each_field([&](auto& field) {
+				std::size_t j = dead;
+				for (std::size_t i = dead; i < count; i++)
+					if (keep[i - dead])
+						field[j++] = field[i];
+				field.resize(kept);
+			});
+		}
+
+		/** Removes all particles but keeps the allocated memory. */
+		void clear() {
+			for_each_field([](auto& field) { field.clear(); });
+		}
+
+		/** Returns the number of living particles. */
+		std::size_t size() const {
+			return x.size();
+		}
+
+		/** Caps the number of living particles, for example to a budget
+		 * scaled by Base::get_quality. Particles beyond it are not 
+		 * removed, but emit drops new ones until enough have faded out.
+		 * @param count The limit, SIZE_MAX for none. */
+		void set_limit(std::size_t count) {
+			limit = count;
+		}
+
+		/** Writes the particles as quads into a range of vertices.
+		 * @param quads Receives 4 vertices per particle. */
+		void write(std::span<SDL_Vertex> quads) const {
+			for (std::size_t i = 0; i < size(); i++) {
+				SDL_Color col = color[i];
+				col.a = static_cast<Uint8>(std::min(alpha[i], 1.0f) * 255.0f);
+				float hw = w[i] / 2, hh = h[i] / 2;
+				SDL_FPoint pos[4] {{-hw, -hh}, {hw, -hh}, {hw, hh}, {-hw, hh}};
+				SDL_FPoint uv[4] {
+					{u0[i], v0[i]}, {u1[i], v0[i]}, {u1[i], v1[i]}, {u0[i], v1[i]}
+				};
+				float c = 1, s = 0;
+				if (angle[i] != 0) {
+					float rad = angle[i] * static_cast<float>(M_PI) / 180.0f;
+					c = std::cos(rad);
+					s = std::sin(rad);
+				}
+				SDL_Vertex* quad = &quads[i * 4];
+				for (int k = 0; k < 4; k++) {
+					SDL_FPoint p = pos[k];
+					quad[k] = {
+						{x[i] + p.x * c - p.y * s, y[i] + p.x * s + p.y * c},
+						col, uv[k]
+					};
+				}
+			}
+		}
+
+		/** Appends the particles to a Geometry as untextured quads. */
+		void write(Geometry& geo) const {
+			write(geo.append_quads(size()));
+		}
+
+		/** Appends the particles to a SpriteBatch.
+		 * @param batch The batch.
+		 * @param tex The texture the uvs refer to.
+		 * @throws std::runtime_error on failure. */
+		void write(SpriteBatch& batch, SDL_Texture* tex) const {
+			write(batch.add_quads(tex, size()));
+		}
+	};
+
+	/** Monospaced bitmap font cut from a bmp sheet of equally sized
+	 * glyph cells in rows, starting at a character code (usually ' ').
+	 * The sheet is a texture region from the texture cache, so a sheet
+	 * packed into an atlas batches with the sprites of its page.
+	 * Laid out strings are kept in a bounded cache keyed by string and
+	 * scale. Created by Base::load_font. */
+	class Font {
+
+		public:
+
+		/** Layouts kept before the cache is cleared. */
+		static constexpr std::size_t max_layouts = 4096;
+
+		private:
+
+		struct Key {
+			std::string text;
+			float scale;
+		};
+
+		struct KeyView {
+			std::string_view text;
+			float scale;
+		};
+
+		struct KeyHash {
+			using is_transparent = void;
+			std::size_t operator()(const KeyView& k) const {
+				Uint32 bits;
+				std::memcpy(&bits, &k.scale, sizeof(bits));
+				return std::hash<std::string_view>()(k.text) ^ mix_hash(bits);
+			}
+			std::size_t operator()(const Key& k) const {
+				return (*this)(KeyView {k.text, k.scale});
+			}
+		};
+
+		struct KeyEqual {
+			using is_transparent = void;
+			static KeyView view(const Key& k) { return {k.text, k.scale}; }
+			static KeyView view(const KeyView& k) { return k; }
+			template <typename A, typename B>
+			bool operator()(const A& a, const B& b) const {
+				return view(a).text == view(b).text && view(a).scale == view(b).scale;
+			}
+		};
+
+		/** Glyph quads relative to the origin of the string. */
+		struct Layout {
+			std::vector<SDL_Vertex> vertices;
+			SDL_FPoint size;
+		};
+
+		TextureRegion sheet;
+		int tex_w, tex_h;
+		int glyph_w, glyph_h;
+		int columns, glyphs;
+		unsigned char first;
+		std::unordered_map<Key, Layout, KeyHash, KeyEqual> layouts;
+
+		friend class Base;
+
+		Font(TextureRegion sheet, int tex_w, int tex_h, int glyph_w, int glyph_h, unsigned char first) :
+			sheet(std::move(sheet)), tex_w(tex_w), tex_h(tex_h),
+			glyph_w(glyph_w), glyph_h(glyph_h),
+			columns(std::max(1, this->sheet.src.w / glyph_w)),
+			glyphs(columns * (this->sheet.src.h / glyph_h)), first(first)
+		{}
+
+		const Layout& layout(std::string_view text, float scale) {
+			auto it = layouts.find(KeyView {text, scale});
+			if (it != layouts.end())
+				return it->second;
+			if (layouts.size() >= max_layouts)
+				layouts.clear();
+			Layout result {{}, {0, 0}};
+			float gw = static_cast<float>(glyph_w) * scale;
+			float gh = static_cast<float>(glyph_h) * scale;
+			float x = 0, y = 0;
+			for (unsigned char c : text) {
+				if (c == '\n') {
+					x = 0;
+					y += gh;
+					continue;
+				}
+				int glyph = c - first;
+				if (glyph >= 0 && glyph < glyphs && c != ' ') {
+					SDL_Rect src {
+						sheet.src.x + glyph % columns * glyph_w,
+						sheet.src.y + glyph / columns * glyph_h,
+						glyph_w, glyph_h
+					};
+					SDL_Vertex quad[4];
+					Geometry::sprite_quad(
+						quad, tex_w, tex_h, &src, {x, y, gw, gh},
+						0, SDL_FLIP_NONE, {255, 255, 255, 255});
+					result.vertices.insert(result.vertices.end(), quad, quad + 4);
+				}
+				x += gw;
+				result.size.x = std::max(result.size.x, x);
+			}
+			if (!text.empty())
+				result.size.y = y + gh;
+			return layouts.emplace(Key {std::string(text), scale}, std::move(result))
+				.first->second;
+		}
+
+		public:
+
+		/** Appends a string to a batch as one quad per visible glyph.
+		 * Many strings in the same batch are drawn together.
+		 * @param batch The batch.
+		 * @param text The string; '\n' starts a new line.
+		 * @param pos The top left corner.
+		 * @param scale The size of a glyph relative to the sheet.
+		 * @param col Color modulation of the glyphs.
+		 * @throws std::runtime_error on failure. */
+		void add(
+			SpriteBatch& batch,
+			std::string_view text,
+			CoordinatesF pos,
+			float scale = 1,
+			SDL_Color col = {255, 255, 255, 255}
+		) {
+			const Layout& l = layout(text, scale);
+			auto quads = batch.add_quads(sheet.tex.get(), l.vertices.size() / 4);
+			for (std::size_t i = 0; i < l.vertices.size(); i++) {
+				SDL_Vertex v = l.vertices[i];
+				v.position.x += pos.x;
+				v.position.y += pos.y;
+				v.color = col;
+				quads[i] = v;
+			}
+		}
+
+		/** Returns the size a string takes up.
+		 * @param text The string.
+		 * @param scale The size of a glyph relative to the sheet. */
+		SDL_FPoint measure(std::string_view text, float scale = 1) {
+			return layout(text, scale).size;
+		}
+
+		/** Returns the size of a glyph in the sheet. */
+		SDL_Point get_glyph_size() const {
+			return {glyph_w, glyph_h};
+		}
+
+		/** Returns the sheet's texture region. */
+		const TextureRegion& get_sheet() const {
+			return sheet;
+		}
+	};
+
+	/** Converts pixels of loaded bmps to ARGB8888 with SIMD kernels 
+	 * picked at run time for the CPU, falling back to scalar code. */
+	class PixelConverter {
+
+		private:
+
+		using Swizzle = void(*)(const Uint8* src, Uint32* dst, std::size_t count);
+		using Kernel = void(*)(Uint32* pixels, std::size_t count, Uint32 key);
+
+		struct Kernels {
+			Swizzle bgr24;
+			Kernel color_key;
+			Kernel premultiply;
+		};
+
+		static void bgr24_scalar(const Uint8* src, Uint32* dst, std::size_t count) {
+			for (std::size_t i = 0; i < count; i++, src += 3)
+				dst[i] = 0xFF000000 | Uint32(src[2]) << 16 | Uint32(src[1]) << 8 | src[0];
+		}
+
+		static void color_key_scalar(Uint32* pixels, std::size_t count, Uint32 key) {
+			for (std::size_t i = 0; i < count; i++)
+				if ((pixels[i] & 0x00FFFFFF) == key)
+					pixels[i] &= 0x00FFFFFF;
+		}
+
+		/** Exact rounded division of c * a by 255. */
+		static Uint32 mul_div255(Uint32 c, Uint32 a) {
+			Uint32 t = c * a + 128;
+			return (t + (t >> 8)) >> 8;
+		}
+
+		static void premultiply_scalar(Uint32* pixels, std::size_t count, Uint32) {
+			for (std::size_t i = 0; i < count; i++) {
+				Uint32 p = pixels[i], a = p >> 24;
+				pixels[i] = (p & 0xFF000000) |
+					mul_div255(p >> 16 & 0xFF, a) << 16 |
+					mul_div255(p >> 8 & 0xFF, a) << 8 |
+					mul_div255(p & 0xFF, a);
+			}
+		}
+
+#ifdef SDL2_BASE_HAS_X86_SIMD
+		SDL2_BASE_TARGET("ssse3")
+		static void bgr24_ssse3(const Uint8* src, Uint32* dst, std::size_t count) {
+			const __m128i shuffle = _mm_setr_epi8(
+				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+			std::size_t i = 0;
+			// The 16 byte loads read one pixel and a bit past the 4 used.
+			for (; i + 6 <= count; i += 4) {
+				__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+				p = _mm_or_si128(_mm_shuffle_epi8(p, shuffle), alpha);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), p);
+			}
+			bgr24_scalar(src + i * 3, dst + i, count - i);
+		}
+
+		SDL2_BASE_TARGET("avx2")
+		static void bgr24_avx2(const Uint8* src, Uint32* dst, std::size_t count) {
+			const __m256i shuffle = _mm256_setr_epi8(
+				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+			std::size_t i = 0;
+			for (; i + 10 <= count; i += 8) {
+				const Uint8* s = src + i * 3;
+				__m256i p = _mm256_inserti128_si256(
+					_mm256_castsi128_si256(
+						_mm_loadu_si128(reinterpret_cast<const __m128i*>(s))),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 12)), 1);
+				p = _mm256_or_si256(_mm256_shuffle_epi8(p, shuffle), alpha);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), p);
+			}
+			bgr24_scalar(src + i * 3, dst + i, count - i);
+		}
+
+		SDL2_BASE_TARGET("sse2")
+		static void color_key_sse2(Uint32* pixels, std::size_t count, Uint32 key) {
+			const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+			const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+			const __m128i k = _mm_set1_epi32(static_cast<int>(key));
+			std::size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				auto* v = reinterpret_cast<__m128i*>(pixels + i);
+				__m128i p = _mm_loadu_si128(v);
+				__m128i match = _mm_cmpeq_epi32(_mm_and_si128(p, rgb), k);
+				_mm_storeu_si128(v, _mm_andnot_si128(_mm_and_si128(match, alpha), p));
+			}
+			color_key_scalar(pixels + i, count - i, key);
+		}
+
+		SDL2_BASE_TARGET("sse2")
+		static __m128i premultiply_half_sse2(__m128i p) {
+			// Alpha is multiplied by 255 so it comes out unchanged.
+			const __m128i keep = _mm_setr_epi16(0, 0, 0, 0xFF, 0, 0, 0, 0xFF);
+			__m128i a = _mm_shufflehi_epi16(
+				_mm_shufflelo_epi16(p, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			__m128i t = _mm_add_epi16(
+				_mm_mullo_epi16(p, _mm_or_si128(a, keep)), _mm_set1_epi16(128));
+			return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+		}
+
+		SDL2_BASE_TARGET("sse2")
+		static void premultiply_sse2(Uint32* pixels, std::size_t count, Uint32 key) {
+			const __m128i zero = _mm_setzero_si128();
+			std::size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				auto* v = reinterpret_cast<__m128i*>(pixels + i);
+				__m128i p = _mm_loadu_si128(v);
+				_mm_storeu_si128(v, _mm_packus_epi16(
+					premultiply_half_sse2(_mm_unpacklo_epi8(p, zero)),
+					premultiply_half_sse2(_mm_unpackhi_epi8(p, zero))));
+			}
+			premultiply_scalar(pixels + i, count - i, key);
+		}
+
+		SDL2_BASE_TARGET("avx2")
+		static __m256i premultiply_half_avx2(__m256i p) {
+			const __m256i keep = _mm256_setr_epi16(
+				0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF);
+			__m256i a = _mm256_shufflehi_epi16(
+				_mm256_shufflelo_epi16(p, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			__m256i t = _mm256_add_epi16(
+				_mm256_mullo_epi16(p, _mm256_or_si256(a, keep)), _mm256_set1_epi16(128));
+			return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+		}
+
+		SDL2_BASE_TARGET("avx2")
+		static void premultiply_avx2(Uint32* pixels, std::size_t count, Uint32 key) {
+			const __m256i zero = _mm256_setzero_si256();
+			std::size_t i = 0;
+			for (; i + 8 <= count; i += 8) {
+				auto* v = reinterpret_cast<__m256i*>(pixels + i);
+				__m256i p = _mm256_loadu_si256(v);
+				_mm256_storeu_si256(v, _mm256_packus_epi16(
+					premultiply_half_avx2(_mm256_unpacklo_epi8(p, zero)),
+					premultiply_half_avx2(_mm256_unpackhi_epi8(p, zero))));
+			}
+			premultiply_scalar(pixels + i, count - i, key);
+		}
+#endif
+
+#ifdef SDL2_BASE_HAS_NEON
+		static void bgr24_neon(const Uint8* src, Uint32* dst, std::size_t count) {
+			std::size_t i = 0;
+			for (; i + 16 <= count; i += 16) {
+				uint8x16x3_t bgr = vld3q_u8(src + i * 3);
+				uint8x16x4_t argb {{bgr.val[0], bgr.val[1], bgr.val[2], vdupq_n_u8(0xFF)}};
+				vst4q_u8(reinterpret_cast<Uint8*>(dst + i), argb);
+			}
+			bgr24_scalar(src + i * 3, dst + i, count - i);
+		}
+
+		static void color_key_neon(Uint32* pixels, std::size_t count, Uint32 key) {
+			const uint32x4_t rgb = vdupq_n_u32(0x00FFFFFF);
+			const uint32x4_t alpha = vdupq_n_u32(0xFF000000);
+			const uint32x4_t k = vdupq_n_u32(key);
+			std::size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				uint32x4_t p = vld1q_u32(pixels + i);
+				uint32x4_t match = vceqq_u32(vandq_u32(p, rgb), k);
+				vst1q_u32(pixels + i, vbicq_u32(p, vandq_u32(match, alpha)));
+			}
+			color_key_scalar(pixels + i, count - i, key);
+		}
+
+		static uint8x8_t mul_div255_neon(uint8x8_t c, uint8x8_t a) {
+			uint16x8_t t = vmull_u8(c, a);
+			return vrshrn_n_u16(vrsraq_n_u16(t, t, 8), 8);
+		}
+
+		static void premultiply_neon(Uint32* pixels, std::size_t count, Uint32 key) {
+			std::size_t i = 0;
+			for (; i + 8 <= count; i += 8) {
+				auto* p = reinterpret_cast<Uint8*>(pixels + i);
+				uint8x8x4_t argb = vld4_u8(p);
+				for (int c = 0; c < 3; c++)
+					argb.val[c] = mul_div255_neon(argb.val[c], argb.val[3]);
+				vst4_u8(p, argb);
+			}
+			premultiply_scalar(pixels + i, count - i, key);
+		}
+#endif
+
+		static const Kernels& get_kernels() {
+			static const Kernels kernels = []{
+				Kernels k {bgr24_scalar, color_key_scalar, premultiply_scalar};
+#ifdef SDL2_BASE_HAS_X86_SIMD
+				if (SDL_HasSSE2()) {
+					k.color_key = color_key_sse2;
+					k.premultiply = premultiply_sse2;
+				}
+				// SDL has no SSSE3 query, every CPU with SSE4.1 has it.
+				if (SDL_HasSSE41())
+					k.bgr24 = bgr24_ssse3;
+				if (SDL_HasAVX2()) {
+					k.bgr24 = bgr24_avx2;
+					k.premultiply = premultiply_avx2;
+				}
+#endif
+#ifdef SDL2_BASE_HAS_NEON
+				if (SDL_HasNEON()) {
+					k.bgr24 = bgr24_neon;
+					k.color_key = color_key_neon;
+					k.premultiply = premultiply_neon;
+				}
+#endif
+				return k;
+			}();
+			return kernels;
+		}
+
+		public:
+
+		/** Converts BGR24 pixels, the format of 24 bit bmps, to opaque
+		 * ARGB8888. */
+		static void bgr24_to_argb8888(const Uint8* src, Uint32* dst, std::size_t count) {
+			get_kernels().bgr24(src, dst, count);
+		}
+
+		/** Makes ARGB8888 pixels whose color is key fully transparent.
+		 * @param key The color as 0xRRGGBB. */
+		static void color_key_to_alpha(Uint32* pixels, std::size_t count, Uint32 key) {
+			get_kernels().color_key(pixels, count, key & 0x00FFFFFF);
+		}
+
+		/** Multiplies the colors of ARGB8888 pixels by their alpha. */
+		static void premultiply_alpha(Uint32* pixels, std::size_t count) {
+			get_kernels().premultiply(pixels, count, 0);
+		}
+
+		/** Converts a surface to a texture format and applies a LoadConfig.
+		 * Pixels are processed as ARGB8888. SDL_ConvertSurfaceFormat is 
+		 * only used for sources other than ARGB8888 and BGR24, and for 
+		 * target formats other than ARGB8888.
+		 * Doesn't throw, so it's safe to call from loader threads.
+		 * @param sur The surface, which may be modified and returned.
+		 * @param format The texture format.
+		 * @param config The LoadConfig.
+		 * @return The converted Surface or nullptr on failure. */
+		static Surface convert(Surface sur, Uint32 format, const LoadConfig& config) {
+			auto free = [](SDL_Surface* s){ if (s) SDL_FreeSurface(s); };
+			if (!sur)
+				return sur;
+			if (sur->format->format == SDL_PIXELFORMAT_BGR24) {
+				Surface argb(SDL_CreateRGBSurfaceWithFormat(
+					0, sur->w, sur->h, 32, SDL_PIXELFORMAT_ARGB8888), free);
+				if (!argb)
+					return argb;
+				for (int y = 0; y < sur->h; y++)
+					bgr24_to_argb8888(
+						static_cast<const Uint8*>(sur->pixels) + y * sur->pitch,
+						reinterpret_cast<Uint32*>(
+							static_cast<Uint8*>(argb->pixels) + y * argb->pitch),
+						static_cast<std::size_t>(sur->w));
+				sur = std::move(argb);
+			} else if (sur->format->format != SDL_PIXELFORMAT_ARGB8888) {
+				sur = Surface(
+					SDL_ConvertSurfaceFormat(sur.get(), SDL_PIXELFORMAT_ARGB8888, 0), free);
+				if (!sur)
+					return sur;
+			}
+
+			if (config.color_key || config.premultiply_alpha) {
+				const SDL_Color key = config.color_key.value_or(SDL_Color{});
+				for (int y = 0; y < sur->h; y++) {
+					auto* row = reinterpret_cast<Uint32*>(
+						static_cast<Uint8*>(sur->pixels) + y * sur->pitch);
+					auto w = static_cast<std::size_t>(sur->w);
+					if (config.color_key)
+						color_key_to_alpha(
+							row, w, Uint32(key.r) << 16 | Uint32(key.g) << 8 | key.b);
+					if (config.premultiply_alpha)
+						premultiply_alpha(row, w);
+				}
+			}
+
+			if (format != SDL_PIXELFORMAT_ARGB8888 && format != SDL_PIXELFORMAT_UNKNOWN)
+				sur = Surface(SDL_ConvertSurfaceFormat(sur.get(), format, 0), free);
+			return sur;
+		}
+	};
+
+	/** Read-only, memory mapped archive of pre-converted textures.
+	 * Layout (little endian): a Header, count Records, the path strings,
+	 * then the pixel data of each record aligned to 16 bytes. 
+	 * Records point into the mapping, so the pixels can be uploaded 
+	 * with SDL_UpdateTexture without any intermediate copy. */
+	class Archive {
+
+		public:
+
+		struct Header {
+			char magic[4];
+			Uint32 version;
+			Uint32 count;
+			Uint32 reserved;
+		};
+
+		struct Record {
+			Uint32 path_offset;
+			Uint32 path_size;
+			Uint32 format;
+			Uint32 w, h;
+			Uint32 pitch;
+			Uint64 data_offset;
+		};
+
+		static constexpr char magic[4] = {'S', 'B', 'A', 'R'};
+		static constexpr Uint32 version = 1;
+		/** The format pack stores pixels in. */
+		static constexpr Uint32 pixel_format = SDL_PIXELFORMAT_ARGB8888;
+
+		private:
+
+		const Uint8* data {nullptr};
+		std::size_t size {0};
+		/** Backing storage on platforms without mmap. */
+		std::vector<Uint8> buffer;
+
+		static Uint64 align(Uint64 offset) {
+			return (offset + 15) & ~Uint64(15);
+		}
+
+		public:
+
+		/** Constructor of the Archive class. Maps the file into memory.
+		 * @param path Path to the archive.
+		 * @throws std::runtime_error on failure. */
+		explicit Archive(const std::string& path) {
+#ifdef SDL2_BASE_HAS_MMAP
+			int fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				throw std::runtime_error("Failed to open archive.");
+			struct stat st;
+			void* map = MAP_FAILED;
+			if (!fstat(fd, &st) && st.st_size > 0) {
+				size = static_cast<std::size_t>(st.st_size);
+				map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			}
+			close(fd);
+			if (map == MAP_FAILED)
+				throw std::runtime_error("Failed to map archive.");
+			data = static_cast<const Uint8*>(map);
+#else
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			if (!file)
+				throw std::runtime_error("Failed to open archive.");
+			buffer.resize(static_cast<std::size_t>(file.tellg()));
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(buffer.data()),
+				static_cast<std::streamsize>(buffer.size()));
+			data = buffer.data();
+			size = buffer.size();
+#endif
+			const Header* header = reinterpret_cast<const Header*>(data);
+			if (size < sizeof(Header) ||
+				std::memcmp(header->magic, magic, sizeof(magic)) ||
+				header->version != version ||
+				size < sizeof(Header) + Uint64(header->count) * sizeof(Record)) {
+				unmap();
+				throw std::runtime_error("Invalid archive.");
+			}
+			for (const auto& record : get_records()) {
+				if (Uint64(record.path_offset) + record.path_size > size ||
+					record.format != pixel_format ||
+					record.pitch < Uint64(record.w) * SDL_BYTESPERPIXEL(pixel_format) ||
+					record.data_offset > size ||
+					Uint64(record.pitch) * record.h > size - record.data_offset) {
+					unmap();
+					throw std::runtime_error("Invalid archive record.");
+				}
+			}
+			SDL2_BASE_LOG_DEBUG("Archive mapped.");
+		}
+
+		Archive(const Archive&) = delete;
+		Archive& operator=(const Archive&) = delete;
+
+		~Archive() {
+			unmap();
+		}
+
+		/** Unmaps the file. */
+		void unmap() {
+#ifdef SDL2_BASE_HAS_MMAP
+			if (data)
+				munmap(const_cast<Uint8*>(data), size);
+#endif
+			data = nullptr;
+			size = 0;
+		}
+
+		/** Returns the records of the archive. */
+		std::span<const Record> get_records() const {
+			const Header* header = reinterpret_cast<const Header*>(data);
+			return {
+				reinterpret_cast<const Record*>(data + sizeof(Header)),
+				header->count
+			};
+		}
+
+		/** Returns the path a record was packed from. */
+		std::string_view get_path(const Record& record) const {
+			return {
+				reinterpret_cast<const char*>(data + record.path_offset),
+				record.path_size
+			};
+		}
+
+		/** Returns the pixels of a record. */
+		const void* get_pixels(const Record& record) const {
+			return data + record.data_offset;
+		}
+
+		/** Packs bmps into an archive, converting them to ARGB8888, which 
+		 * is the native texture format of SDL's common renderers.
+		 * @param out_path Path of the archive to write.
+		 * @param bmps Paths to the bmps.
+		 * @throws std::runtime_error on failure. */
+		static void pack(
+			const std::string& out_path,
+			std::span<const std::string_view> bmps
+		) {
+			auto free = [](SDL_Surface* s){ if (s) SDL_FreeSurface(s); };
+			std::vector<Surface> surfaces;
+			std::vector<Record> records;
+			Uint64 strings = sizeof(Header) + bmps.size() * sizeof(Record);
+			Uint64 offset = strings;
+			for (auto bmp : bmps) {
+				Surface raw(SDL_LoadBMP(std::string(bmp).c_str()), free);
+				if (!raw)
+					throw std::runtime_error("Failed to load bmp.");
+				surfaces.push_back(PixelConverter::convert(
+					std::move(raw), pixel_format, {}));
+				const auto& sur = surfaces.back();
+				if (!sur)
+					throw std::runtime_error("Failed to convert bmp.");
+				records.push_back({
+					static_cast<Uint32>(offset), static_cast<Uint32>(bmp.size()),
+					pixel_format,
+					static_cast<Uint32>(sur->w), static_cast<Uint32>(sur->h),
+					static_cast<Uint32>(sur->w) * SDL_BYTESPERPIXEL(pixel_format), 0
+				});
+				offset += bmp.size();
+			}
+			for (auto& record : records) {
+				offset = align(offset);
+				record.data_offset = offset;
+				offset += Uint64(record.pitch) * record.h;
+			}
+
+			std::ofstream file(out_path, std::ios::binary | std::ios::trunc);
+			if (!file)
+				throw std::runtime_error("Failed to create archive.");
+			Header header {{}, version, static_cast<Uint32>(records.size()), 0};
+			std::memcpy(header.magic, magic, sizeof(magic));
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(records.data()),
+				static_cast<std::streamsize>(records.size() * sizeof(Record)));
+			for (auto bmp : bmps)
+				file.write(bmp.data(), static_cast<std::streamsize>(bmp.size()));
+			for (std::size_t i = 0; i < records.size(); i++) {
+				const Record& record = records[i];
+				while (static_cast<Uint64>(file.tellp()) < record.data_offset)
+					file.put(0);
+				SDL_Surface* sur = surfaces[i].get();
+				for (int y = 0; y < sur->h; y++)
+					file.write(
+						static_cast<const char*>(sur->pixels) + y * sur->pitch,
+						record.pitch
+					);
+			}
+			if (!file)
+				throw std::runtime_error("Failed to write archive.");
+			SDL2_BASE_LOG_DEBUG("Archive written.");
+		}
+	};
+
+	/** Open addressing hash table of texture entries keyed by bmp path.
+	 * Lookups take a std::string_view and never allocate. Every path is
+	 * interned once into a dense entry array, whose index is a TextureId
+	 * that gives O(1) access afterwards. */
+	class TextureCache {
+
+		public:
+
+		/** Marks the end of the LRU list. */
+		static constexpr TextureId none = UINT32_MAX;
+
+		/** A cached bmp path and its textures. */
+		struct Entry {
+			std::string path;
+			std::size_t hash;
+			/** Standalone texture or nullptr if not loaded. */
+			Texture tex;
+			/** Region inside an atlas page or a null texture if the path 
+			 * is not part of an atlas. */
+			TextureRegion region {nullptr, {0, 0, 0, 0}};
+			/** Whether an asynchronous load is in flight. */
+			bool pending {false};
+			/** The archive holding the pixels or nullptr for loose bmps. */
+			const Archive* archive {nullptr};
+			/** Index of the record in the archive. */
+			Uint32 record {0};
+			/** Size of tex in bytes. */
+			std::size_t bytes {0};
+			/** Neighbours in the LRU list of resident textures. */
+			TextureId lru_prev {none};
+			TextureId lru_next {none};
+			/** Number of acquired TextureHandles, which pin tex. */
+			Uint32 handles {0};
+			/** Incremented whenever tex is evicted. */
+			Uint32 generation {0};
+			/** Whether the bmp is watched for hot reloading. */
+			bool watched {false};
+		};
+
+		private:
+
+		struct Slot {
+			/** TextureId + 1, 0 marks an empty slot. */
+			Uint32 id;
+			/** Upper bits of the hash to skip most string comparisons. */
+			Uint32 tag;
+		};
+
+		std::vector<Entry> entries;
+		std::vector<Slot> slots = std::vector<Slot>(16, Slot {0, 0});
+		/** Most and least recently used resident entries. */
+		TextureId lru_head {none};
+		TextureId lru_tail {none};
+
+		static Uint32 tag_of(std::size_t hash) {
+			return static_cast<Uint32>(static_cast<Uint64>(hash) >> 32);
+		}
+
+		/** Returns the slot index of path or of the empty slot where it 
+		 * would be inserted. */
+		std::size_t probe(std::string_view path, std::size_t hash) const {
+			std::size_t mask = slots.size() - 1;
+			Uint32 tag = tag_of(hash);
+			for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+				const Slot& slot = slots[i];
+				if (!slot.id ||
+					(slot.tag == tag && entries[slot.id - 1].path == path))
+					return i;
+			}
+		}
+
+		void grow() {
+			std::vector<Slot> old(slots.size() * 2, Slot {0, 0});
+			old.swap(slots);
+			std::size_t mask = slots.size() - 1;
+			for (const auto& slot : old) {
+				if (!slot.id)
+					continue;
+				std::size_t i = entries[slot.id - 1].hash & mask;
+				while (slots[i].id)
+					i = (i + 1) & mask;
+				slots[i] = slot;
+			}
+		}
+
+		public:
+
+		/** 64 bit FNV-1a hash of a path.
+		 * @param path The path.
+		 * @return The hash. */
+		static std::size_t hash(std::string_view path) {
+			Uint64 h = 14695981039346656037ull;
+			for (unsigned char c : path) {
+				h ^= c;
+				h *= 1099511628211ull;
+			}
+			return static_cast<std::size_t>(h);
+		}
+
+		/** Looks up a path without allocating.
+		 * @param path The path.
+		 * @return The TextureId or std::nullopt if the path is not interned. */
+		std::optional<TextureId> find(std::string_view path) const {
+			const Slot& slot = slots[probe(path, hash(path))];
+			if (!slot.id)
+				return std::nullopt;
+			return slot.id - 1;
+		}
+
+		/** Interns a path, creating an empty entry if it's new.
+		 * @param path The path.
+		 * @return The TextureId of the path. */
+		TextureId intern(std::string_view path) {
+			std::size_t h = hash(path);
+			std::size_t i = probe(path, h);
+			if (slots[i].id)
+				return slots[i].id - 1;
+			TextureId id = static_cast<TextureId>(entries.size());
+			entries.push_back({std::string(path), h, nullptr});
+			slots[i] = {id + 1, tag_of(h)};
+			if (entries.size() * 2 > slots.size())
+				grow();
+			return id;
+		}
+
+		/** Returns the entry of an interned path.
+		 * @param id The TextureId.
+		 * @return The entry. */
+		Entry& operator[](TextureId id) {
+			return entries[id];
+		}
+
+		/** Returns the entry of an interned path.
+		 * @param id The TextureId.
+		 * @return The entry. */
+		const Entry& operator[](TextureId id) const {
+			return entries[id];
+		}
+
+		/** Returns the number of interned paths. */
+		std::size_t size() const {
+			return entries.size();
+		}
+
+		/** Moves an entry to the front of the LRU list, inserting it if it
+		 * wasn't in the list.
+		 * @param id The TextureId. */
+		void touch(TextureId id) {
+			if (lru_head == id)
+				return;
+			unlink(id);
+			entries[id].lru_next = lru_head;
+			if (lru_head != none)
+				entries[lru_head].lru_prev = id;
+			lru_head = id;
+			if (lru_tail == none)
+				lru_tail = id;
+		}
+
+		/** Removes an entry from the LRU list if it's in it.
+		 * @param id The TextureId. */
+		void unlink(TextureId id) {
+			auto& entry = entries[id];
+			if (entry.lru_prev == none && lru_head != id)
+				return;
+			if (entry.lru_prev != none)
+				entries[entry.lru_prev].lru_next = entry.lru_next;
+			else
+				lru_head = entry.lru_next;
+			if (entry.lru_next != none)
+				entries[entry.lru_next].lru_prev = entry.lru_prev;
+			else
+				lru_tail = entry.lru_prev;
+			entry.lru_prev = entry.lru_next = none;
+		}
+
+		/** Returns the least recently used entry or none. */
+		TextureId least_recent() const {
+			return lru_tail;
+		}
+
+		/** Returns the next more recently used entry or none.
+		 * @param id The TextureId. */
+		TextureId more_recent(TextureId id) const {
+			return entries[id].lru_prev;
+		}
+	};
+
+	/** Counters of the texture cache for sizing its budget. */
+	struct TextureCacheStats {
+		std::size_t hits;
+		std::size_t misses;
+		std::size_t evictions;
+		/** Textures replaced after their bmps changed on disk. */
+		std::size_t reloads;
+		/** Bytes held by resident standalone textures. */
+		std::size_t resident_bytes;
+		std::size_t budget;
+	};
+
+	/** Bump allocator for transient per-frame data, reset as a whole in
+	 * Base::present. Allocations from any thread bump an atomic offset 
+	 * into a single block without locking. If the block runs out, the 
+	 * rest of the frame falls back to locked heap allocations and the 
+	 * next reset grows the block so the steady state stays lock-free.
+	 * Memory must not be used after the reset. */
+	class FrameArena {
+
+		private:
+
+		std::unique_ptr<std::byte[]> block;
+		std::size_t capacity;
+		std::atomic<std::size_t> offset {0};
+		std::mutex overflow_mutex;
+		std::vector<std::unique_ptr<std::byte[]>> overflow;
+		std::size_t overflow_bytes {0};
+
+		public:
+
+		/** Constructor of the FrameArena class.
+		 * @param capacity The initial size of the block in bytes. */
+		explicit FrameArena(std::size_t capacity = 1 << 20) :
+			block(new std::byte[capacity]), capacity(capacity)
+		{}
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+
+		/** Allocates uninitialized memory. Safe to call concurrently.
+		 * @param size The size in bytes.
+		 * @param align The alignment, a power of two.
+		 * @return The memory. */
+		void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) {
+			auto base = reinterpret_cast<std::uintptr_t>(block.get());
+			std::size_t off = offset.load(std::memory_order_relaxed);
+			while (true) {
+				std::size_t start = ((base + off + align - 1) & ~(align - 1)) - base;
+				if (start + size > capacity)
+					break;
+				if (offset.compare_exchange_weak(
+					off, start + size, std::memory_order_relaxed))
+					return block.get() + start;
+			}
+			std::lock_guard lock(overflow_mutex);
+			std::size_t space = size + align;
+			overflow.emplace_back(new std::byte[space]);
+			overflow_bytes += space;
+			void* ptr = overflow.back().get();
+			return std::align(align, size, ptr, space);
+		}
+
+		/** Releases all allocations, growing the block if the last 
+		 * frame overflowed. No allocation may be in flight. */
+		void reset() {
+			if (overflow_bytes) {
+				capacity = std::max(capacity * 2, get_used());
+				block.reset(new std::byte[capacity]);
+				overflow.clear();
+				overflow_bytes = 0;
+				SDL2_BASE_LOG_DEBUG("Frame arena grown.");
+			}
+			offset.store(0, std::memory_order_relaxed);
+		}
+
+		/** Returns the number of bytes allocated since the last reset. */
+		std::size_t get_used() const {
+			return offset.load(std::memory_order_relaxed) + overflow_bytes;
+		}
+
+		/** Returns the size of the block in bytes. */
+		std::size_t get_capacity() const {
+			return capacity;
+		}
+	};
+
+	/** Sub-arena for a single thread. Takes chunks from a FrameArena 
+	 * and bumps a plain pointer inside them, so there is no atomic 
+	 * operation per allocation. Must not outlive the frame. */
+	class LocalArena {
+
+		private:
+
+		FrameArena& parent;
+		std::size_t chunk;
+		std::byte* cursor {nullptr};
+		std::byte* end {nullptr};
+
+		public:
+
+		/** Constructor of the LocalArena class.
+		 * @param parent The arena to take chunks from.
+		 * @param chunk The size of a chunk in bytes. */
+		explicit LocalArena(FrameArena& parent, std::size_t chunk = 64 * 1024) :
+			parent(parent), chunk(chunk)
+		{}
+
+		/** Allocates uninitialized memory. Not thread safe.
+		 * @param size The size in bytes.
+		 * @param align The alignment, a power of two.
+		 * @return The memory. */
+		void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) {
+			void* ptr = cursor;
+			std::size_t space = static_cast<std::size_t>(end - cursor);
+			if (!cursor || !std::align(align, size, ptr, space)) {
+				std::size_t bytes = std::max(chunk, size + align);
+				cursor = static_cast<std::byte*>(parent.allocate(bytes));
+				end = cursor + bytes;
+				ptr = cursor;
+				space = bytes;
+				std::align(align, size, ptr, space);
+			}
+			cursor = static_cast<std::byte*>(ptr) + size;
+			return ptr;
+		}
+	};
+
+	/** STL allocator drawing from a FrameArena or LocalArena. 
+	 * Deallocation is a no-op, memory is reclaimed when the arena 
+	 * is reset. */
+	template <typename T, typename Arena = FrameArena>
+	class ArenaAllocator {
+
+		template <typename U, typename A>
+		friend class ArenaAllocator;
+
+		Arena* arena;
+
+		public:
+
+		using value_type = T;
+
+		ArenaAllocator(Arena& arena) noexcept : arena(&arena) {}
+
+		template <typename U>
+		ArenaAllocator(const ArenaAllocator<U, Arena>& other) noexcept :
+			arena(other.arena)
+		{}
+
+		T* allocate(std::size_t n) {
+			return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T*, std::size_t) noexcept {}
+
+		template <typename U>
+		bool operator==(const ArenaAllocator<U, Arena>& other) const noexcept {
+			return arena == other.arena;
+		}
+	};
+
+	/** A std::vector living in a frame arena. */
+	template <typename T, typename Arena = FrameArena>
+	using FrameVector = std::vector<T, ArenaAllocator<T, Arena>>;
+
+	/** Fixed size pool of worker threads executing tasks in FIFO order.
+	 * Queued tasks are finished before the destructor returns. */
+	class ThreadPool {
+
+		private:
+
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool stopping {false};
+
+		void work() {
+			while (true) {
+				std::function<void()> task;
+				{
+					std::unique_lock lock(mutex);
+					cv.wait(lock, [this]{ return stopping || !tasks.empty(); });
+					if (tasks.empty())
+						return;
+					task = std::move(tasks.front());
+					tasks.pop_front();
+				}
+				task();
+			}
+		}
+
+		public:
+
+		/** Constructor of the ThreadPool class.
+		 * @param count The number of worker threads. 
+		 * 0 uses one less than the number of hardware threads. */
+		explicit ThreadPool(unsigned count = 0) {
+			if (!count) {
+				unsigned threads = std::thread::hardware_concurrency();
+				count = threads > 1 ? threads - 1 : 1;
+			}
+			for (unsigned i = 0; i < count; i++)
+				workers.emplace_back([this]{ work(); });
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool() {
+			{
+				std::lock_guard lock(mutex);
+				stopping = true;
+			}
+			cv.notify_all();
+			for (auto& worker : workers)
+				worker.join();
+		}
+
+		/** Queues a task. Tasks must not throw.
+		 * @param task The task. */
+		void submit(std::function<void()> task) {
+			{
+				std::lock_guard lock(mutex);
+				tasks.push_back(std::move(task));
+			}
+			cv.notify_one();
+		}
+
+		/** Returns the number of worker threads. */
+		std::size_t size() const {
+			return workers.size();
+		}
+	};
+
+	/** Watches files for changes on a background thread with inotify and
+	 * calls back with the tag a file was added with after it has been 
+	 * written (or atomically replaced). Only the directories are watched,
+	 * so editors that save through a rename are picked up as well.
+	 * Other platforms than Linux are not supported. */
+	class FileWatcher {
+
+		public:
+
+		/** Called on the watcher thread with a tag and path passed to 
+		 * add. Must not throw. */
+		using Callback = std::function<void(Uint32 tag, const std::string& path)>;
+
+		private:
+
+		struct File {
+			Uint32 tag;
+			std::string path;
+		};
+
+		/** Files by name per watch descriptor. */
+		std::unordered_map<int, std::unordered_map<std::string, std::vector<File>>> dirs;
+		std::mutex mutex;
+		Callback callback;
+		int fd {-1};
+		int wake {-1};
+		std::thread thread;
+
+#ifdef SDL2_BASE_HAS_INOTIFY
+		void run() {
+			alignas(inotify_event) char buffer[4096];
+			pollfd fds[2] {{fd, POLLIN, 0}, {wake, POLLIN, 0}};
+			std::vector<File> changed;
+			while (true) {
+				if (poll(fds, 2, -1) < 0) {
+					if (errno == EINTR)
+						continue;
+					return;
+				}
+				if (fds[1].revents)
+					return;
+				ssize_t len = read(fd, buffer, sizeof(buffer));
+				if (len <= 0)
+					continue;
+				changed.clear();
+				{
+					std::lock_guard lock(mutex);
+					for (char* p = buffer; p < buffer + len;) {
+						auto* event = reinterpret_cast<inotify_event*>(p);
+						p += sizeof(inotify_event) + event->len;
+						auto dir = dirs.find(event->wd);
+						if (!event->len || dir == dirs.end())
+							continue;
+						auto file = dir->second.find(event->name);
+						if (file != dir->second.end())
+							changed.insert(changed.end(),
+								file->second.begin(), file->second.end());
+					}
+				}
+				for (std::size_t i = 0; i < changed.size(); i++) {
+					bool repeated = false;
+					for (std::size_t j = 0; j < i && !repeated; j++)
+						repeated = changed[j].tag == changed[i].tag;
+					if (!repeated)
+						callback(changed[i].tag, changed[i].path);
+				}
+			}
+		}
+#endif
+
+		public:
+
+		/** Constructor of the FileWatcher class. Starts the watcher thread.
+		 * @param callback Called for every changed file.
+		 * @throws std::runtime_error on failure or if file watching is 
+		 * not supported on this platform. */
+		explicit FileWatcher(Callback callback) : callback(std::move(callback)) {
+#ifdef SDL2_BASE_HAS_INOTIFY
+			fd = inotify_init1(IN_CLOEXEC);
+			wake = eventfd(0, EFD_CLOEXEC);
+			if (fd < 0 || wake < 0) {
+				if (fd >= 0) close(fd);
+				if (wake >= 0) close(wake);
+				throw std::runtime_error("Failed to initialize inotify.");
+			}
+			thread = std::thread([this]{ run(); });
+#else
+			throw std::runtime_error("File watching is not supported on this platform.");
+#endif
+		}
+
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+
+		/** Stops the watcher thread. */
+		~FileWatcher() {
+#ifdef SDL2_BASE_HAS_INOTIFY
+			Uint64 one = 1;
+			if (write(wake, &one, sizeof(one)) != sizeof(one))
+				SDL2_BASE_LOG_ERROR("Failed to wake the file watcher.");
+			thread.join();
+			close(fd);
+			close(wake);
+#endif
+		}
+
+		/** Starts watching a file. A file may be added with several tags.
+		 * @param path Path to the file.
+		 * @param tag Passed to the callback when the file changes.
+		 * @return false if its directory can't be watched. */
+		bool add(std::string_view path, Uint32 tag) {
+#ifdef SDL2_BASE_HAS_INOTIFY
+			auto slash = path.rfind('/');
+			std::string dir = slash == std::string_view::npos ? "." :
+				std::string(path.substr(0, std::max<std::size_t>(slash, 1)));
+			std::string name(path.substr(slash + 1));
+			int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (wd < 0)
+				return false;
+			std::lock_guard lock(mutex);
+			dirs[wd][name].push_back({tag, std::string(path)});
+			return true;
+#else
+			(void)path;
+			(void)tag;
+			return false;
+#endif
+		}
+	};
+
+	/** Skyline bottom-left rectangle packer for a single atlas page. */
+	class SkylinePacker {
+
+		private:
+
+		struct Node {
+			int x, y, w;
+		};
+
+		int width, height;
+		std::vector<Node> skyline;
+		long long used_area {0};
+
+		/** Returns the lowest y at which a w wide rectangle fits when its
+		 * left edge is placed at skyline node i, or -1 if it doesn't fit. */
+		int fit(std::size_t i, int w, int h) const {
+			int x = skyline[i].x;
+			if (x + w > width)
+				return -1;
+			int y = 0;
+			for (int left = w; left > 0; i++) {
+				y = std::max(y, skyline[i].y);
+				if (y + h > height)
+					return -1;
+				left -= skyline[i].w;
+			}
+			return y;
+		}
+
+		public:
+
+		/** Constructor of the SkylinePacker class.
+		 * @param width The width of the page.
+		 * @param height The height of the page. */
+		SkylinePacker(int width, int height) :
+			width(width), height(height), skyline{{0, 0, width}}
+		{}
+
+		/** Finds room for a rectangle.
+		 * @param w The width of the rectangle.
+		 * @param h The height of the rectangle.
+		 * @return The position of the rectangle or std::nullopt if it 
+		 * doesn't fit into the page. */
+		std::optional<SDL_Rect> insert(int w, int h) {
+			std::size_t best = skyline.size();
+			int best_y = height, best_w = width;
+			for (std::size_t i = 0; i < skyline.size(); i++) {
+				int y = fit(i, w, h);
+				if (y < 0)
+					continue;
+				if (best == skyline.size() || y < best_y ||
+					(y == best_y && skyline[i].w < best_w)) {
+					best = i;
+					best_y = y;
+					best_w = skyline[i].w;
+				}
+			}
+			if (best == skyline.size())
+				return std::nullopt;
+
+			SDL_Rect rect {skyline[best].x, best_y, w, h};
+			skyline.insert(skyline.begin() + static_cast<long>(best), {rect.x, rect.y + h, w});
+			for (std::size_t i = best + 1; i < skyline.size();) {
+				int shrink = skyline[i - 1].x + skyline[i - 1].w - skyline[i].x;
+				if (shrink <= 0)
+					break;
+				skyline[i].x += shrink;
+				skyline[i].w -= shrink;
+				if (skyline[i].w > 0)
+					break;
+				skyline.erase(skyline.begin() + static_cast<long>(i));
+			}
+			for (std::size_t i = 0; i + 1 < skyline.size();) {
+				if (skyline[i].y == skyline[i + 1].y) {
+					skyline[i].w += skyline[i + 1].w;
+					skyline.erase(skyline.begin() + static_cast<long>(i + 1));
+				} else {
+					i++;
+				}
+			}
+			used_area += static_cast<long long>(w) * h;
+			return rect;
+		}
+
+		/** Returns the highest point of the skyline. */
+		int get_used_height() const {
+			int h = 0;
+			for (const auto& node : skyline)
+				h = std::max(h, node.y);
+			return h;
+		}
+
+		/** Returns the total area of the inserted rectangles. */
+		long long get_used_area() const {
+			return used_area;
+		}
+	};
+
+	/** Collects FrameStats of the most recent frames into a ring buffer.
+	 * The render thread is the only writer; any thread can read.
+	 * Slots are guarded by sequence counters, so neither side locks. */
+	class Profiler {
+
+		public:
+
+		static constexpr std::size_t capacity = 512;
+
+		private:
+
+		struct Slot {
+			std::atomic<Uint32> seq {0};
+			FrameStats stats;
+		};
+
+		std::array<Slot, capacity> slots;
+		std::atomic<Uint64> frames {0};
+		FrameStats current {};
+		SDL_Texture* last_texture {nullptr};
+		bool in_scope {false};
+		double ms_per_tick =
+			1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+
+		friend class ProfileScope;
+		friend class PresentScope;
+
+		public:
+
+		Profiler() {
+			current.start = SDL_GetPerformanceCounter();
+		}
+
+		/** Counts a draw call and a texture bind if tex differs from the 
+		 * texture of the previous draw call.
+		 * @param tex The texture of the draw call or nullptr. */
+		void count_draw_call(SDL_Texture* tex) {
+			current.draw_calls++;
+			if (tex && tex != last_texture)
+				current.texture_binds++;
+			last_texture = tex;
+		}
+
+		/** Counts vertices submitted in a draw call.
+		 * @param count The number of vertices. */
+		void count_vertices(std::size_t count) {
+			current.vertices += static_cast<Uint32>(count);
+		}
+
+		/** Publishes the current frame and starts the next one. */
+		void end_frame() {
+			Uint64 now = SDL_GetPerformanceCounter();
+			current.frame_ticks = now - current.start;
+			Uint64 frame = frames.load(std::memory_order_relaxed);
+			Slot& slot = slots[frame % capacity];
+			Uint32 seq = slot.seq.load(std::memory_order_relaxed);
+			slot.seq.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			slot.stats = current;
+			slot.seq.store(seq + 2, std::memory_order_release);
+			frames.store(frame + 1, std::memory_order_release);
+			current = {};
+			current.start = now;
+			last_texture = nullptr;
+		}
+
+		/** Returns the number of frames recorded so far. */
+		Uint64 get_frame_count() const {
+			return frames.load(std::memory_order_acquire);
+		}
+
+		/** Copies the stats of the most recent frames, oldest first.
+		 * @param last_n The number of frames, at most capacity.
+		 * @return The FrameStats. */
+		std::vector<FrameStats> get_frames(std::size_t last_n) const {
+			Uint64 end = get_frame_count();
+			Uint64 n = std::min<Uint64>({last_n, end, capacity});
+			std::vector<FrameStats> result;
+			result.reserve(n);
+			for (Uint64 frame = end - n; frame < end; frame++) {
+				const Slot& slot = slots[frame % capacity];
+				FrameStats stats;
+				Uint32 seq;
+				do {
+					seq = slot.seq.load(std::memory_order_acquire);
+					stats = slot.stats;
+					std::atomic_thread_fence(std::memory_order_acquire);
+				} while (seq & 1 || seq != slot.seq.load(std::memory_order_relaxed));
+				result.push_back(stats);
+			}
+			return result;
+		}
+
+		/** Summarizes a tick measurement of the most recent frames.
+		 * @param last_n The number of frames.
+		 * @param ticks_of Returns the measurement of a FrameStats.
+		 * @return The Summary in ms. */
+		template <typename F>
+		Summary summarize(std::size_t last_n, F ticks_of) const {
+			auto stats = get_frames(last_n);
+			if (stats.empty())
+				return {0, 0, 0};
+			std::vector<double> ms;
+			ms.reserve(stats.size());
+			for (const auto& frame : stats)
+				ms.push_back(static_cast<double>(ticks_of(frame)) * ms_per_tick);
+			std::sort(ms.begin(), ms.end());
+			double sum = std::accumulate(ms.begin(), ms.end(), 0.0);
+			std::size_t p99 = (ms.size() * 99 + 99) / 100 - 1;
+			return {ms.front(), sum / static_cast<double>(ms.size()), ms[p99]};
+		}
+
+		/** Summarizes the CPU time of a phase.
+		 * @param last_n The number of frames.
+		 * @param phase The phase.
+		 * @return The Summary in ms. */
+		Summary summarize(std::size_t last_n, Phase phase) const {
+			return summarize(last_n, [phase](const FrameStats& frame) {
+				return frame.phase_ticks[phase];
+			});
+		}
+
+		/** Summarizes the whole frame time.
+		 * @param last_n The number of frames.
+		 * @return The Summary in ms. */
+		Summary summarize_frames(std::size_t last_n) const {
+			return summarize(last_n, [](const FrameStats& frame) {
+				return frame.frame_ticks;
+			});
+		}
+
+		/** Writes the most recent frames in the Chrome trace event format,
+		 * viewable in chrome://tracing or Perfetto.
+		 * @param out The stream to write to.
+		 * @param last_n The number of frames. */
+		void write_chrome_trace(std::ostream& out, std::size_t last_n) const {
+			static constexpr const char* names[PHASE_COUNT] = {
+				"clear", "draw", "present", "poll_events"
+			};
+			double us_per_tick = ms_per_tick * 1000.0;
+			auto event = [&](const char* name, Uint64 start, Uint64 ticks) {
+				out << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+					<< ",\"ts\":" << static_cast<double>(start) * us_per_tick
+					<< ",\"dur\":" << static_cast<double>(ticks) * us_per_tick << "}";
+			};
+			out << "{\"traceEvents\":[";
+			bool first = true;
+			for (const auto& frame : get_frames(last_n)) {
+				out << (first ? "" : ",");
+				first = false;
+				event("frame", frame.start, frame.frame_ticks);
+				for (int phase = 0; phase < PHASE_COUNT; phase++) {
+					if (!frame.phase_start[phase])
+						continue;
+					out << ",";
+					event(names[phase], frame.phase_start[phase], frame.phase_ticks[phase]);
+				}
+			}
+			out << "]}\n";
+		}
+	};
+
+	/** Adds the lifetime of the outermost scope to a phase of the 
+	 * current frame. */
+	class ProfileScope {
+
+		private:
+
+		Profiler& profiler;
+		Phase phase;
+		Uint64 start;
+		bool outermost;
+
+		public:
+
+		ProfileScope(Profiler& profiler, Phase phase) :
+			profiler(profiler), phase(phase),
+			start(SDL_GetPerformanceCounter()),
+			outermost(!profiler.in_scope)
+		{
+			profiler.in_scope = true;
+		}
+
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+
+		~ProfileScope() {
+			if (!outermost)
+				return;
+			profiler.in_scope = false;
+			FrameStats& frame = profiler.current;
+			frame.phase_ticks[phase] += SDL_GetPerformanceCounter() - start;
+			if (!frame.phase_start[phase])
+				frame.phase_start[phase] = start;
+		}
+	};
+
+	/** Adds its lifetime to the present blocking time of the current 
+	 * frame. */
+	class PresentScope {
+
+		private:
+
+		Profiler& profiler;
+		Uint64 start;
+
+		public:
+
+		explicit PresentScope(Profiler& profiler) :
+			profiler(profiler), start(SDL_GetPerformanceCounter())
+		{}
+
+		PresentScope(const PresentScope&) = delete;
+		PresentScope& operator=(const PresentScope&) = delete;
+
+		~PresentScope() {
+			profiler.current.present_ticks += SDL_GetPerformanceCounter() - start;
+		}
+	};
+
+	/** Turns frame times into a quality factor between 
+	 * QualityConfig::min_quality and 1. The 95th percentile frame time
+	 * of every window of frames is compared against the budget; the gap
+	 * between the two thresholds and the number of good windows needed
+	 * to raise quality keep it from oscillating around the budget. */
+	class QualityController {
+
+		private:
+
+		QualityConfig config;
+		std::vector<double> samples;
+		float quality {1};
+		int good_windows {0};
+		double p95 {0};
+
+		public:
+
+		/** Constructor of the QualityController class.
+		 * @param config The QualityConfig. */
+		explicit QualityController(const QualityConfig& config = {}) :
+			config(config)
+		{
+			samples.reserve(std::max<std::size_t>(1, config.window));
+		}
+
+		/** Adds the time of a frame.
+		 * @param ms The frame time in ms.
+		 * @return Whether the quality changed. */
+		bool add_frame(double ms) {
+			samples.push_back(ms);
+			if (samples.size() < std::max<std::size_t>(1, config.window))
+				return false;
+			auto nth = samples.begin() +
+				static_cast<std::ptrdiff_t>((samples.size() * 95 + 99) / 100 - 1);
+			std::nth_element(samples.begin(), nth, samples.end());
+			p95 = *nth;
+			samples.clear();
+			float previous = quality;
+			if (p95 > config.budget_ms * config.lower_above) {
+				quality = std::max(config.min_quality, quality - config.step);
+				good_windows = 0;
+			} else if (p95 < config.budget_ms * config.raise_below) {
+				if (++good_windows >= config.raise_after) {
+					quality = std::min(1.0f, quality + config.step);
+					good_windows = 0;
+				}
+			} else {
+				good_windows = 0;
+			}
+			return quality != previous;
+		}
+
+		/** Returns the quality factor. */
+		float get_quality() const {
+			return quality;
+		}
+
+		/** Returns the p95 frame time of the last full window in ms. */
+		double get_p95() const {
+			return p95;
+		}
+	};
+
+	/** Content cached in a render target texture that is only 
+	 * re-rendered by Base::update_layer when marked dirty, either 
+	 * entirely or in a region. Created by Base::create_layer. */
+	class Layer {
+
+		private:
+
+		Texture target;
+		int w, h;
+		bool dirty {true};
+		std::optional<SDL_Rect> region;
+
+		friend class Base;
+
+		Layer(Texture target, int w, int h) :
+			target(std::move(target)), w(w), h(h)
+		{}
+
+		public:
+
+		/** Marks the whole layer for re-rendering. */
+		void mark_dirty() {
+			dirty = true;
+			region.reset();
+		}
+
+		/** Marks a region for re-rendering. Multiple regions are merged
+		 * into their bounding rectangle.
+		 * @param rect The region in layer coordinates. */
+		void mark_dirty(const SDL_Rect& rect) {
+			if (dirty && !region)
+				return;
+			if (region)
+				SDL_UnionRect(&*region, &rect, &*region);
+			else
+				region = rect;
+			dirty = true;
+		}
+
+		/** Checks if the layer needs re-rendering. */
+		bool is_dirty() const {
+			return dirty;
+		}
+
+		/** Returns the render target texture. */
+		const Texture& get_texture() const {
+			return target;
+		}
+
+		/** Returns the size of the layer. */
+		SDL_Point get_size() const {
+			return {w, h};
+		}
+	};
+
+	/** A view of the world drawn into a viewport of the screen. The 
+	 * world is scaled by zoom around the center of the view. */
+	class Camera {
+
+		private:
+
+		CoordinatesF center {0, 0};
+		float zoom {1};
+		SDL_FRect viewport {0, 0, 0, 0};
+
+		public:
+
+		Camera() = default;
+
+		/** Constructor of the Camera class.
+		 * @param center The world position shown at the viewport's center.
+		 * @param viewport The screen area the view is drawn into.
+		 * @param zoom Screen pixels per world unit. */
+		Camera(CoordinatesF center, const SDL_FRect& viewport, float zoom = 1) :
+			center(center), zoom(zoom), viewport(viewport)
+		{}
+
+		void set_center(CoordinatesF center) {
+			this->center = center;
+		}
+
+		/** Moves the view by an offset in world units. */
+		void move(float dx, float dy) {
+			center.x += dx;
+			center.y += dy;
+		}
+
+		CoordinatesF get_center() const {
+			return center;
+		}
+
+		void set_zoom(float zoom) {
+			this->zoom = zoom;
+		}
+
+		float get_zoom() const {
+			return zoom;
+		}
+
+		void set_viewport(const SDL_FRect& viewport) {
+			this->viewport = viewport;
+		}
+
+		const SDL_FRect& get_viewport() const {
+			return viewport;
+		}
+
+		/** Returns the visible area of the world. */
+		SDL_FRect get_view() const {
+			float w = viewport.w / zoom, h = viewport.h / zoom;
+			return {center.x - w / 2, center.y - h / 2, w, h};
+		}
+
+		/** Checks if a world rectangle overlaps the view. */
+		bool is_visible(const SDL_FRect& world) const {
+			SDL_FRect view = get_view();
+			return world.x < view.x + view.w && view.x < world.x + world.w &&
+				world.y < view.y + view.h && view.y < world.y + world.h;
+		}
+
+		/** Converts a world rectangle to screen coordinates. */
+		SDL_FRect to_screen(const SDL_FRect& world) const {
+			SDL_FRect view = get_view();
+			return {
+				(world.x - view.x) * zoom + viewport.x,
+				(world.y - view.y) * zoom + viewport.y,
+				world.w * zoom, world.h * zoom
+			};
+		}
+
+		/** Converts a screen position, e.g. the mouse, to the world. */
+		CoordinatesF to_world(CoordinatesF screen) const {
+			SDL_FRect view = get_view();
+			return {
+				(screen.x - viewport.x) / zoom + view.x,
+				(screen.y - viewport.y) / zoom + view.y
+			};
+		}
+	};
+
+	/** Uniform grid of items with bounds, for finding the items in an 
+	 * area such as a Camera's view. Only the cells overlapping the area
+	 * are visited, so a query costs about as much as the items it 
+	 * returns rather than the size of the world. Cells are stored 
+	 * sparsely, so the world is unbounded.
+	 * @tparam T The value stored with each item. */
+	template <typename T>
+	class SpatialGrid {
+
+		public:
+
+		using ItemId = Uint32;
+
+		private:
+
+		struct Item {
+			SDL_FRect bounds;
+			T value;
+			/** The cells covered, inclusive. */
+			int x0, y0, x1, y1;
+			/** The query that last visited the item. */
+			Uint32 stamp;
+		};
+
+		float cell_size;
+		std::vector<Item> items;
+		std::vector<ItemId> free_ids;
+		std::unordered_map<Coordinates, std::vector<ItemId>> cells;
+		std::vector<ItemId> results;
+		Uint32 stamp {0};
+		std::size_t count {0};
+
+		int cell(float v) const {
+			return static_cast<int>(std::floor(v / cell_size));
+		}
+
+		void link(ItemId id) {
+			const Item& item = items[id];
+			for (int y = item.y0; y <= item.y1; y++)
+				for (int x = item.x0; x <= item.x1; x++)
+					cells[{x, y}].push_back(id);
+		}
+
+		void unlink(ItemId id) {
+			const Item& item = items[id];
+			for (int y = item.y0; y <= item.y1; y++)
+				for (int x = item.x0; x <= item.x1; x++) {
+					auto it = cells.find({x, y});
+					auto& ids = it->second;
+					*std::find(ids.begin(), ids.end(), id) = ids.back();
+					ids.pop_back();
+					if (ids.empty())
+						cells.erase(it);
+				}
+		}
+
+		void set_cells(Item& item) {
+			const SDL_FRect& b = item.bounds;
+			item.x0 = cell(b.x);
+			item.y0 = cell(b.y);
+			item.x1 = cell(b.x + b.w);
+			item.y1 = cell(b.y + b.h);
+		}
+
+		public:
+
+		/** Constructor of the SpatialGrid class.
+		 * @param cell_size The width and height of a cell in world units,
+		 * ideally a few times the size of a typical item. */
+		explicit SpatialGrid(float cell_size = 256) :
+			cell_size(cell_size)
+		{}
+
+		/** Adds an item.
+		 * @param bounds The bounds of the item in world units.
+		 * @param value The value stored with the item.
+		 * @return The ItemId, valid until the item is removed. */
+		ItemId insert(const SDL_FRect& bounds, T value) {
+			ItemId id;
+			if (free_ids.empty()) {
+				id = static_cast<ItemId>(items.size());
+				items.push_back({bounds, std::move(value), 0, 0, 0, 0, stamp});
+			} else {
+				id = free_ids.back();
+				free_ids.pop_back();
+				items[id] = {bounds, std::move(value), 0, 0, 0, 0, stamp};
+			}
+			set_cells(items[id]);
+			link(id);
+			count++;
+			return id;
+		}
+
+		/** Updates the bounds of an item. The cells are only touched if 
+		 * the item crosses into different ones.
+		 * @param id The ItemId.
+		 * @param bounds The new bounds. */
+		void move(ItemId id, const SDL_FRect& bounds) {
+			Item& item = items[id];
+			Item moved = item;
+			moved.bounds = bounds;
+			set_cells(moved);
+			if (moved.x0 != item.x0 || moved.y0 != item.y0 ||
+				moved.x1 != item.x1 || moved.y1 != item.y1) {
+				unlink(id);
+				item = std::move(moved);
+				link(id);
+			} else {
+				item.bounds = bounds;
+			}
+		}
+
+		/** Removes an item. Its ItemId may be reused by a later insert.
+		 * @param id The ItemId. */
+		void remove(ItemId id) {
+			unlink(id);
+			free_ids.push_back(id);
+			count--;
+		}
+
+		/** Returns the items overlapping an area, each once. The span is 
+		 * valid until the next query.
+		 * @param area The area in world units.
+		 * @return The ItemIds in no particular order. */
+		std::span<const ItemId> query(const SDL_FRect& area) {
+			results.clear();
+			if (++stamp == 0) {
+				for (auto& item : items)
+					item.stamp = 0;
+				stamp = 1;
+			}
+			int x0 = cell(area.x), y0 = cell(area.y);
+			int x1 = cell(area.x + area.w), y1 = cell(area.y + area.h);
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++) {
+					auto it = cells.find({x, y});
+					if (it == cells.end())
+						continue;
+					for (ItemId id : it->second) {
+						Item& item = items[id];
+						if (item.stamp == stamp)
+							continue;
+						item.stamp = stamp;
+						const SDL_FRect& b = item.bounds;
+						if (b.x < area.x + area.w && area.x < b.x + b.w &&
+							b.y < area.y + area.h && area.y < b.y + b.h)
+							results.push_back(id);
+					}
+				}
+			return results;
+		}
+
+		/** Returns the value of an item. */
+		T& get(ItemId id) {
+			return items[id].value;
+		}
+
+		const T& get(ItemId id) const {
+			return items[id].value;
+		}
+
+		/** Returns the bounds of an item. */
+		const SDL_FRect& get_bounds(ItemId id) const {
+			return items[id].bounds;
+		}
+
+		/** Returns the number of items. */
+		std::size_t size() const {
+			return count;
+		}
+	};
+
+	/** Dense grid of tiles for tile maps and collision data, allocated
+	 * in chunks of chunk_size x chunk_size tiles as they are written.
+	 * Each field is a separate array per chunk (structure of arrays) in
+	 * Morton order, so neighbouring tiles are close in memory in both 
+	 * directions and iterating one field doesn't load the others.
+	 * @tparam Fields The value types stored per tile. */
+	template <typename... Fields>
+	class ChunkedGrid {
+
+		public:
+
+		static constexpr int chunk_bits = 5;
+		static constexpr int chunk_size = 1 << chunk_bits;
+		static constexpr std::size_t chunk_tiles = chunk_size * chunk_size;
+
+		struct Chunk {
+			std::tuple<std::array<Fields, chunk_tiles>...> fields {};
+		};
+
+		private:
+
+		std::vector<std::unique_ptr<Chunk>> chunks;
+		std::unordered_map<Coordinates, Uint32> index;
+
+		/** Interleaves the bits of local tile coordinates. */
+		static std::size_t morton(int x, int y) {
+			auto spread = [](unsigned v) {
+				v = (v | v << 8) & 0x00FF00FF;
+				v = (v | v << 4) & 0x0F0F0F0F;
+				v = (v | v << 2) & 0x33333333;
+				return (v | v << 1) & 0x55555555;
+			};
+			return spread(static_cast<unsigned>(x)) |
+				spread(static_cast<unsigned>(y)) << 1;
+		}
+
+		static Coordinates chunk_of(Coordinates tile) {
+			return {tile.x >> chunk_bits, tile.y >> chunk_bits};
+		}
+
+		static std::size_t tile_of(Coordinates tile) {
+			return morton(tile.x & (chunk_size - 1), tile.y & (chunk_size - 1));
+		}
+
+		Chunk* find_chunk(Coordinates chunk) const {
+			auto it = index.find(chunk);
+			return it == index.end() ? nullptr : chunks[it->second].get();
+		}
+
+		public:
+
+		/** Returns a field of a tile, allocating its chunk with value
+		 * initialized tiles if needed.
+		 * @tparam I The index of the field.
+		 * @param tile The tile coordinates. */
+		template <std::size_t I>
+		auto& get(Coordinates tile) {
+			auto [it, added] = index.try_emplace(
+				chunk_of(tile), static_cast<Uint32>(chunks.size()));
+			if (added)
+				chunks.push_back(std::make_unique<Chunk>());
+			return std::get<I>(chunks[it->second]->fields)[tile_of(tile)];
+		}
+
+		/** Returns a field of a tile or nullptr if its chunk hasn't been
+		 * allocated.
+		 * @tparam I The index of the field.
+		 * @param tile The tile coordinates. */
+		template <std::size_t I>
+		const auto* find(Coordinates tile) const {
+			Chunk* chunk = find_chunk(chunk_of(tile));
+			return chunk ? &std::get<I>(chunk->fields)[tile_of(tile)] : nullptr;
+		}
+
+		/** Calls f(Coordinates, Fields&...) for every allocated tile in a
+		 * region, chunk by chunk. Unallocated chunks are skipped.
+		 * @param region The region in tile coordinates. */
+		template <typename F>
+		void for_each(const SDL_Rect& region, F&& f) {
+			if (region.w <= 0 || region.h <= 0)
+				return;
+			Coordinates first = chunk_of({region.x, region.y});
+			Coordinates last = chunk_of({region.x + region.w - 1, region.y + region.h - 1});
+			for (int cy = first.y; cy <= last.y; cy++)
+				for (int cx = first.x; cx <= last.x; cx++) {
+					Chunk* chunk = find_chunk({cx, cy});
+					if (!chunk)
+						continue;
+					int x0 = std::max(region.x, cx * chunk_size);
+					int y0 = std::max(region.y, cy * chunk_size);
+					int x1 = std::min(region.x + region.w, (cx + 1) * chunk_size);
+					int y1 = std::min(region.y + region.h, (cy + 1) * chunk_size);
+					for (int y = y0; y < y1; y++)
+						for (int x = x0; x < x1; x++) {
+							std::size_t i = tile_of({x, y});
+							std::apply([&](auto&... arrays) {
+								f(Coordinates{x, y}, arrays[i]...);
+							}, chunk->fields);
+						}
+				}
+		}
+
+		/** Returns the allocated chunks, e.g. for bulk processing of a 
+		 * field regardless of position. */
+		std::span<const std::unique_ptr<Chunk>> get_chunks() const {
+			return chunks;
+		}
+
+		/** Frees all chunks. */
+		void clear() {
+			chunks.clear();
+			index.clear();
+		}
+	};
+
+	class StreamingTexture;
+
+	/** Write access to the locked pixels of a StreamingTexture. 
+	 * The pixels are write-only and must all be written; the texture is
+	 * unlocked when the lock is destroyed. */
+	class PixelLock {
+
+		private:
+
+		StreamingTexture* stream;
+		std::size_t buffer;
+		void* pixels;
+		int pitch;
+
+		friend class StreamingTexture;
+
+		PixelLock(StreamingTexture* stream, std::size_t buffer, void* pixels, int pitch) :
+			stream(stream), buffer(buffer), pixels(pixels), pitch(pitch)
+		{}
+
+		public:
+
+		PixelLock(PixelLock&& other) noexcept :
+			stream(std::exchange(other.stream, nullptr)), buffer(other.buffer),
+			pixels(other.pixels), pitch(other.pitch)
+		{}
+
+		PixelLock(const PixelLock&) = delete;
+		PixelLock& operator=(const PixelLock&) = delete;
+		PixelLock& operator=(PixelLock&&) = delete;
+
+		inline ~PixelLock();
+
+		/** Returns the first pixel of the locked area. */
+		void* get_pixels() const {
+			return pixels;
+		}
+
+		/** Returns the length of a row in bytes. */
+		int get_pitch() const {
+			return pitch;
+		}
+
+		/** Returns a row of the locked area. */
+		template <typename T = Uint32>
+		T* row(int y) const {
+			return reinterpret_cast<T*>(static_cast<Uint8*>(pixels) + y * pitch);
+		}
+	};
+
+	/** Texture for pixels updated by the CPU every frame, such as video.
+	 * Whole-frame writes go to the least recently shown of several 
+	 * SDL_TEXTUREACCESS_STREAMING textures, so they don't wait for the
+	 * GPU to finish with the texture on screen, and that buffer becomes
+	 * the one returned by get_texture. Writes to a sub-rectangle go to
+	 * the shown buffer so every buffer stays complete. 
+	 * Created by Base::create_streaming_texture. */
+	class StreamingTexture {
+
+		private:
+
+		std::vector<Texture> buffers;
+		std::size_t front {0};
+		int w, h;
+		/** Buffer locked for a whole-frame write, or buffers.size(). */
+		std::size_t locked;
+
+		friend class Base;
+		friend class PixelLock;
+
+		StreamingTexture(std::vector<Texture> buffers, int w, int h) :
+			buffers(std::move(buffers)), w(w), h(h), locked(this->buffers.size())
+		{}
+
+		std::size_t back() const {
+			return (front + 1) % buffers.size();
+		}
+
+		public:
+
+		/** Locks pixels for writing without a copy.
+		 * @param rect The area to lock or nullptr for a whole-frame write 
+		 * into the next buffer.
+		 * @return The PixelLock.
+		 * @throws std::runtime_error on failure. */
+		PixelLock lock(const SDL_Rect* rect = nullptr) {
+			std::size_t buffer = rect ? front : back();
+			void* pixels;
+			int pitch;
+			if (SDL_LockTexture(buffers[buffer].get(), rect, &pixels, &pitch))
+				throw std::runtime_error("Failed to lock texture.");
+			if (!rect)
+				locked = buffer;
+			return PixelLock(this, buffer, pixels, pitch);
+		}
+
+		/** Copies pixels into the texture.
+		 * @param rect The area to update or nullptr for a whole-frame 
+		 * update of the next buffer.
+		 * @param pixels The pixels in the texture's format.
+		 * @param pitch The length of a row of pixels in bytes.
+		 * @throws std::runtime_error on failure. */
+		void update(const SDL_Rect* rect, const void* pixels, int pitch) {
+			std::size_t buffer = rect ? front : back();
+			if (SDL_UpdateTexture(buffers[buffer].get(), rect, pixels, pitch))
+				throw std::runtime_error("Failed to update texture.");
+			front = buffer;
+		}
+
+		/** Returns the most recently completed buffer for drawing. */
+		const Texture& get_texture() const {
+			return buffers[front];
+		}
+
+		/** Returns the number of buffers. */
+		std::size_t get_buffer_count() const {
+			return buffers.size();
+		}
+
+		/** Returns the size of the texture. */
+		SDL_Point get_size() const {
+			return {w, h};
+		}
+	};
+
+	PixelLock::~PixelLock() {
+		if (!stream)
+			return;
+		SDL_UnlockTexture(stream->buffers[buffer].get());
+		if (stream->locked == buffer) {
+			stream->front = buffer;
+			stream->locked = stream->buffers.size();
+		}
+	}
+
+	/** Records untextured and textured quads as compact POD commands
+	 * for deferred submission with Base::submit. Before submission the 
+	 * commands are radix sorted by layer, texture and blend mode, so runs
+	 * of commands sharing a texture and blend mode become one 
+	 * SDL_RenderGeometry call. The sort is stable, but draws with 
+	 * different textures or blend modes within a layer may be reordered;
+	 * use layers where overlap matters. A buffer can be submitted any
+	 * number of times, e.g. for static layers. It stores raw texture 
+	 * pointers, so the textures have to outlive its contents. */
+	class CommandBuffer {
+
+		public:
+
+		/** A recorded quad. The key holds, from the most significant 
+		 * bits, the layer (16 bits), the texture slot (16 bits) 
+		 * and the blend mode slot (8 bits). */
+		struct Command {
+			Uint64 key;
+			Uint32 quad;
+		};
+
+		static constexpr int key_bits = 40;
+
+		private:
+
+		std::vector<Command> commands;
+		std::vector<Command> scratch;
+		std::vector<SDL_Vertex> vertices;
+		/** Slot 0 is reserved for untextured commands. */
+		std::vector<SDL_Texture*> textures {nullptr};
+		std::vector<SDL_Point> texture_sizes {{0, 0}};
+		std::vector<SDL_BlendMode> blend_modes;
+		Uint32 last_texture {0};
+		bool sorted {true};
+
+		std::vector<Uint32> texture_remap;
+		std::vector<Uint32> blend_remap;
+
+		/** Returns the slot of a texture, adding it if needed. The size is
+		 * queried with SDL_QueryTexture, which only reads immutable fields
+		 * of the texture, unless it's known. */
+		Uint32 texture_slot(SDL_Texture* tex, const SDL_Point* known_size = nullptr) {
+			if (textures[last_texture] == tex)
+				return last_texture;
+			auto it = std::find(textures.begin(), textures.end(), tex);
+			if (it == textures.end()) {
+				if (textures.size() > UINT16_MAX)
+					throw std::runtime_error("Too many textures in command buffer.");
+				SDL_Point size;
+				if (known_size)
+					size = *known_size;
+				else if (SDL_QueryTexture(tex, nullptr, nullptr, &size.x, &size.y))
+					throw std::runtime_error("Failed to query texture.");
+				texture_sizes.push_back(size);
+				it = textures.insert(textures.end(), tex);
+			}
+			return last_texture = static_cast<Uint32>(it - textures.begin());
+		}
+
+		Uint32 blend_slot(SDL_BlendMode blend) {
+			auto it = std::find(blend_modes.begin(), blend_modes.end(), blend);
+			if (it == blend_modes.end()) {
+				if (blend_modes.size() > UINT8_MAX)
+					throw std::runtime_error("Too many blend modes in command buffer.");
+				it = blend_modes.insert(blend_modes.end(), blend);
+			}
+			return static_cast<Uint32>(it - blend_modes.begin());
+		}
+
+		void record(
+			const SDL_Vertex (&quad)[4],
+			Uint32 tex,
+			int layer,
+			SDL_BlendMode blend
+		) {
+			Uint64 l = static_cast<Uint16>(
+				std::clamp(layer, INT16_MIN, INT16_MAX) - INT16_MIN);
+			Uint64 key = l << 24 | Uint64(tex) << 8 | blend_slot(blend);
+			sorted = sorted && (commands.empty() || commands.back().key <= key);
+			commands.push_back({key, static_cast<Uint32>(vertices.size() / 4)});
+			vertices.insert(vertices.end(), quad, quad + 4);
+		}
+
+		public:
+
+		/** Records an untextured, axis aligned rectangle.
+		 * @param rect The rectangle.
+		 * @param col The fill color.
+		 * @param layer Lower layers are drawn first.
+		 * @param blend The blend mode.
+		 * @throws std::runtime_error on failure. */
+		void add_rect(
+			const SDL_FRect& rect,
+			SDL_Color col,
+			int layer = 0,
+			SDL_BlendMode blend = SDL_BLENDMODE_BLEND
+		) {
+			SDL_Vertex quad[4];
+			Geometry::rect_quad(quad, rect, col);
+			record(quad, 0, layer, blend);
+		}
+
+		/** Records a sprite.
+		 * @param tex The texture to sample from.
+		 * @param srcrect The source rectangle or nullptr for the whole texture.
+		 * @param dstrect The destination rectangle.
+		 * @param angle Clockwise rotation around the center of dstrect 
+		 * in degrees.
+		 * @param flip Flipping of the sprite.
+		 * @param col Color modulation of the sprite.
+		 * @param layer Lower layers are drawn first.
+		 * @param blend The blend mode.
+		 * @throws std::runtime_error on failure. */
+		void add_sprite(
+			SDL_Texture* tex,
+			const SDL_Rect* srcrect,
+			const SDL_FRect& dstrect,
+			float angle = 0,
+			SDL_RendererFlip flip = SDL_FLIP_NONE,
+			SDL_Color col = {255, 255, 255, 255},
+			int layer = 0,
+			SDL_BlendMode blend = SDL_BLENDMODE_BLEND
+		) {
+			Uint32 slot = texture_slot(tex);
+			SDL_Vertex quad[4];
+			Geometry::sprite_quad(
+				quad, texture_sizes[slot].x, texture_sizes[slot].y,
+				srcrect, dstrect, angle, flip, col);
+			record(quad, slot, layer, blend);
+		}
+
+		/** Records the sprites of a SpriteBatch, each run with the 
+		 * current blend mode of its texture.
+		 * @param batch The batch.
+		 * @param layer Lower layers are drawn first.
+		 * @throws std::runtime_error on failure. */
+		void add_batch(const SpriteBatch& batch, int layer = 0) {
+			const auto& geo = batch.get_geometry();
+			for (const auto& run : batch.get_runs()) {
+				SDL_BlendMode blend;
+				if (SDL_GetTextureBlendMode(run.tex, &blend))
+					throw std::runtime_error("Failed to get blend mode.");
+				Uint32 slot = texture_slot(run.tex);
+				for (std::size_t i = 0; i < run.index_count; i += 6) {
+					auto first = static_cast<std::size_t>(geo.indices[run.first_index + i]);
+					const SDL_Vertex* v = geo.vertices.data() + first;
+					record({v[0], v[1], v[2], v[3]}, slot, layer, blend);
+				}
+			}
+		}
+
+		/** Appends the commands of another buffer after this buffer's own.
+		 * Merging per-thread buffers in a fixed order therefore gives the
+		 * same submission order regardless of thread timing.
+		 * @param other The buffer to append.
+		 * @throws std::runtime_error if the merged buffer would have too 
+		 * many textures or blend modes. */
+		void append(const CommandBuffer& other) {
+			texture_remap.resize(other.textures.size());
+			texture_remap[0] = 0;
+			for (std::size_t i = 1; i < other.textures.size(); i++)
+				texture_remap[i] = texture_slot(other.textures[i], &other.texture_sizes[i]);
+			blend_remap.resize(other.blend_modes.size());
+			for (std::size_t i = 0; i < other.blend_modes.size(); i++)
+				blend_remap[i] = blend_slot(other.blend_modes[i]);
+			Uint32 quad_offset = static_cast<Uint32>(vertices.size() / 4);
+			for (const auto& command : other.commands) {
+				Uint64 key = (command.key & ~Uint64(0xFFFFFF)) |
+					Uint64(texture_remap[(command.key >> 8) & 0xFFFF]) << 8 |
+					blend_remap[command.key & 0xFF];
+				sorted = sorted && (commands.empty() || commands.back().key <= key);
+				commands.push_back({key, command.quad + quad_offset});
+			}
+			vertices.insert(vertices.end(), other.vertices.begin(), other.vertices.end());
+		}
+
+		/** Stable LSD radix sort of the commands by key. 
+		 * Passes over bytes that are equal in all keys are skipped. */
+		void sort() {
+			if (sorted)
+				return;
+			scratch.resize(commands.size());
+			for (int shift = 0; shift < key_bits; shift += 8) {
+				std::array<std::size_t, 257> offsets {};
+				for (const auto& command : commands)
+					offsets[((command.key >> shift) & 0xFF) + 1]++;
+				if (std::find(offsets.begin(), offsets.end(), commands.size())
+					!= offsets.end())
+					continue;
+				std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+				for (const auto& command : commands)
+					scratch[offsets[(command.key >> shift) & 0xFF]++] = command;
+				commands.swap(scratch);
+			}
+			sorted = true;
+		}
+
+		/** Removes all commands but keeps the allocated memory. */
+		void clear() {
+			commands.clear();
+			vertices.clear();
+			textures.resize(1);
+			texture_sizes.resize(1);
+			blend_modes.clear();
+			last_texture = 0;
+			sorted = true;
+		}
+
+		/** Checks if no commands were recorded. */
+		bool empty() const {
+			return commands.empty();
+		}
+
+		/** Checks if the commands are in submission order. */
+		bool is_sorted() const {
+			return sorted;
+		}
+
+		/** Returns the commands. */
+		std::span<const Command> get_commands() const {
+			return commands;
+		}
+
+		/** Returns the vertices, 4 per quad. */
+		std::span<const SDL_Vertex> get_vertices() const {
+			return vertices;
+		}
+
+		/** Returns the texture of a key, nullptr if untextured. */
+		SDL_Texture* get_texture(Uint64 key) const {
+			return textures[(key >> 8) & 0xFFFF];
+		}
+
+		/** Returns the blend mode of a key. */
+		SDL_BlendMode get_blend_mode(Uint64 key) const {
+			return blend_modes[key & 0xFF];
+		}
+	};
+
+	/** A frame read back by Base's capture. The pixels are ARGB8888 and
+	 * only valid during the callback. */
+	struct CapturedFrame {
+		std::span<const Uint8> pixels;
+		int w, h, pitch;
+		/** The number of the frame since the capture started. */
+		Uint64 index;
+	};
+
+	/** Called on a capture worker thread for each captured frame. 
+	 * Must not throw. */
+	using CaptureCallback = std::function<void(const CapturedFrame&)>;
+
+	/** State of a capture started by Base::start_capture. Frames are 
+	 * rendered into a ring of target textures and each one is read 
+	 * back when the ring comes around to it, so the readback waits on 
+	 * a frame that is several frames old instead of the one just 
+	 * submitted. Readback buffers are recycled through a pool. */
+	class FrameCapture {
+
+		private:
+
+		std::vector<Texture> targets;
+		std::size_t current {0};
+		Uint64 rendered {0};
+		int w, h;
+		CaptureCallback callback;
+		std::size_t max_pending;
+		std::mutex pool_mutex;
+		std::vector<std::vector<Uint8>> pool;
+		std::size_t pending {0};
+		std::atomic<Uint64> captured {0};
+		Uint64 dropped {0};
+		/** Destroyed first, finishing the queued frames. */
+		ThreadPool workers;
+
+		friend class Base;
+
+		FrameCapture(
+			std::vector<Texture> targets, int w, int h,
+			CaptureCallback callback, std::size_t max_pending, unsigned workers
+		) :
+			targets(std::move(targets)), w(w), h(h),
+			callback(std::move(callback)), max_pending(max_pending), workers(workers)
+		{}
+
+		public:
+
+		/** Returns the number of frames passed to the callback so far. */
+		Uint64 get_captured() const {
+			return captured.load(std::memory_order_relaxed);
+		}
+
+		/** Returns the number of frames skipped because max_pending 
+		 * frames were already waiting for the workers. */
+		Uint64 get_dropped() const {
+			return dropped;
+		}
+
+		/** Returns the size of the captured frames. */
+		SDL_Point get_size() const {
+			return {w, h};
+		}
+	};
+
+	// Main class
+
+	/** Class store and manage SDL2_Base resources. */
+	class Base {
+
+		private:
+
+		/** Class to manage the SDL2 session. */
+		class SDL {
+
+			private:
+			
+			Uint32 flags;
+			
+			public:
+
+			/** Constructor of the SDL class.
+			 * @param flags SDL init flags.
+			 * @throws std::runtime_error on failure. */
+			SDL(Uint32 flags) : flags(flags) {
+				if (SDL_Init(flags))
+					throw std::runtime_error("Failed to init SDL.");
+				SDL2_BASE_LOG_DEBUG("SDL2 initialized.");
+			}
+
+			~SDL() {
+				if (SDL_WasInit(flags) == flags)
+					SDL_Quit();
+				SDL2_BASE_LOG_DEBUG("SDL2 terminated.");
+			}
+
+		};
+
+		// Variables
+
+		SDL sdl;
+		Window win;
+		/** The render target in headless mode. */
+		Surface canvas {nullptr, SDL_FreeSurface};
+		Renderer ren;
+		[[maybe_unused]] SDL_Event event;
+		[[maybe_unused]] State state {RUNNING};
+		Input input;
+		/** Handler slot + 1 per event type, 0 if there is no handler. 
+		 * Allocated on the first registration. */
+		std::vector<Uint8> handler_slots;
+		std::vector<EventHandler> handlers;
+		std::array<SDL_Event, 64> event_buffer;
+		TextureCache textures;
+		std::size_t atlas_regions {0};
+		std::vector<Texture> atlas_pages;
+		AtlasStats atlas_stats {0, 0, 0};
+		long long atlas_used_area {0};
+		long long atlas_total_area {0};
+		Geometry geometry;
+		SpriteBatch handle_batch;
+		bool deferred {false};
+		int layer {0};
+		CommandBuffer frame_commands;
+		std::vector<Texture> frame_textures;
+#ifdef SDL2_BASE_PROFILE
+		Profiler profiler;
+#endif
+#ifdef SDL2_BASE_RECORD_ERRORS
+		DrawErrors draw_errors {0, nullptr};
+		DrawErrors frame_errors {0, nullptr};
+#endif
+		Texture placeholder;
+		Camera camera;
+		std::optional<QualityController> quality;
+		std::function<void(float)> on_quality;
+		/** End of the previous present while adapting quality. */
+		Uint64 frame_start {0};
+		LoadConfig load_config;
+		Uint32 texture_format {SDL_PIXELFORMAT_UNKNOWN};
+		std::size_t upload_budget {SIZE_MAX};
+		std::size_t pending_loads {0};
+		std::vector<std::unique_ptr<Archive>> archives;
+		FrameArena frame_arena;
+		TextureCacheStats cache_stats {0, 0, 0, 0, 0, SIZE_MAX};
+
+		/** A surface decoded by the loader pool, nullptr on failure. */
+		struct DecodedSurface {
+			TextureId id;
+			Surface sur;
+		};
+		std::mutex decoded_mutex;
+		std::deque<DecodedSurface> decoded;
+		/** Surfaces of changed bmps decoded by the watcher thread. */
+		std::deque<DecodedSurface> reloaded;
+		/** Destroyed first so no worker outlives the completion queue. */
+		std::unique_ptr<ThreadPool> loader;
+		std::vector<CommandBuffer> thread_commands;
+		CommandBuffer merged_commands;
+		std::unique_ptr<ThreadPool> recorders;
+		std::unique_ptr<ThreadPool> encoder;
+		std::unique_ptr<FrameCapture> capture;
+		/** Destroyed first so its thread doesn't outlive the reload queue. */
+		std::unique_ptr<FileWatcher> watcher;
+
+		/** Loads a bmp into a Surface.
+		 * @param path_to_bmp Path to the bmp file.
+		 * @throws std::runtime_error on failure. */
+		static Surface load_surface(std::string_view path_to_bmp) {
+			return Surface(
+				[&](){
+					auto s = SDL_LoadBMP(path_to_bmp.data());
+					if (!s) throw std::runtime_error("Failed to load bmp.");
+					SDL2_BASE_LOG_DEBUG("Texture created from bmp: {}", path_to_bmp);
+					return s;
+				}(),
+				[](SDL_Surface* s){
+					if (s) SDL_FreeSurface(s);
+					SDL2_BASE_LOG_DEBUG("Surface freed.");
+				}
+			);
+		}
+
+		/** Loads a bmp and converts it to the texture format so that the 
+		 * Texture can be created without a conversion on the render thread.
+		 * Doesn't throw, so it's safe to call from loader threads.
+		 * @param path_to_bmp Path to the bmp file. 
+		 * @param format The texture format.
+		 * @param config The LoadConfig.
+		 * @return The Surface or nullptr on failure. */
+		static Surface decode_surface(
+			const std::string& path_to_bmp,
+			Uint32 format,
+			const LoadConfig& config
+		) {
+			return PixelConverter::convert(
+				Surface(SDL_LoadBMP(path_to_bmp.c_str()),
+					[](SDL_Surface* s){ if (s) SDL_FreeSurface(s); }),
+				format, config);
+		}
+
+		/** Loads a bmp and converts it to the texture format.
+		 * @param path_to_bmp Path to the bmp file.
+		 * @param format The texture format.
+		 * @throws std::runtime_error on failure. */
+		Surface load_converted_surface(std::string_view path_to_bmp, Uint32 format) {
+			Surface sur = PixelConverter::convert(
+				load_surface(path_to_bmp), format, load_config);
+			if (!sur)
+				throw std::runtime_error("Failed to convert bmp.");
+			return sur;
+		}
+
+		/** Creates a Texture straight from an archive's mapping.
+		 * @param entry An archive backed cache entry.
+		 * @throws std::runtime_error on failure. */
+		Texture create_archive_texture(const TextureCache::Entry& entry) {
+			const auto& record = entry.archive->get_records()[entry.record];
+			Texture tex(
+				SDL_CreateTexture(
+					ren.get(), record.format, SDL_TEXTUREACCESS_STATIC,
+					static_cast<int>(record.w), static_cast<int>(record.h)),
+				[](SDL_Texture* t){
+					if (t) SDL_DestroyTexture(t);
+					SDL2_BASE_LOG_DEBUG("Texture destroyed.");
+				}
+			);
+			if (!tex || SDL_UpdateTexture(
+				tex.get(), nullptr, entry.archive->get_pixels(record),
+				static_cast<int>(record.pitch))
+			)
+				throw std::runtime_error("Failed to create texture from archive.");
+			SDL_SetTextureBlendMode(tex.get(), SDL_BLENDMODE_BLEND);
+			return tex;
+		}
+
+		/** Sleeps until a performance counter value, spinning for the 
+		 * last 2 ms since SDL_Delay may oversleep by about that much.
+		 * @param deadline The performance counter value.
+		 * @param freq The performance counter frequency. */
+		static void wait_until(Uint64 deadline, Uint64 freq) {
+			const Uint64 spin = freq / 500;
+			for (Uint64 now = SDL_GetPerformanceCounter(); now < deadline;
+				now = SDL_GetPerformanceCounter()) {
+				if (deadline - now > spin)
+					SDL_Delay(1);
+				else
+					std::this_thread::yield();
+			}
+		}
+
+		/** Makes a texture resident in an entry and evicts least recently
+		 * used textures if the budget is exceeded.
+		 * @param id The TextureId of the entry.
+		 * @param tex The texture.
+		 * @return The size of the texture in bytes.
+		 * @throws std::runtime_error on failure. */
+		std::size_t store_texture(TextureId id, Texture tex) {
+			Uint32 format;
+			int w, h;
+			if (SDL_QueryTexture(tex.get(), &format, nullptr, &w, &h))
+				throw std::runtime_error("Failed to query texture.");
+			auto& entry = textures[id];
+			entry.tex = std::move(tex);
+			entry.bytes = static_cast<std::size_t>(w) *
+				static_cast<std::size_t>(h) * SDL_BYTESPERPIXEL(format);
+			cache_stats.resident_bytes += entry.bytes;
+			textures.touch(id);
+			watch_texture(id);
+			evict(id);
+			return entry.bytes;
+		}
+
+		/** Adds a loose bmp to the file watcher if hot reloading is on.
+		 * @param id The TextureId of the bmp. */
+		void watch_texture(TextureId id) {
+			auto& entry = textures[id];
+			if (watcher && !entry.watched && !entry.archive) {
+				entry.watched = watcher->add(entry.path, id);
+				if (!entry.watched)
+					SDL2_BASE_LOG_WARN("Failed to watch bmp: {}", entry.path);
+			}
+		}
+
+		/** Copies a reloaded surface into a texture if it has the same 
+		 * size and format.
+		 * @param tex The texture.
+		 * @param rect The area of the texture or nullptr for all of it.
+		 * @param sur The surface.
+		 * @return false if the surface doesn't fit.
+		 * @throws std::runtime_error on failure. */
+		static bool update_texture(SDL_Texture* tex, const SDL_Rect* rect, SDL_Surface* sur) {
+			Uint32 format;
+			int w, h;
+			if (SDL_QueryTexture(tex, &format, nullptr, &w, &h))
+				throw std::runtime_error("Failed to query texture.");
+			if (rect) {
+				w = rect->w;
+				h = rect->h;
+			}
+			if (w != sur->w || h != sur->h || format != sur->format->format)
+				return false;
+			if (SDL_UpdateTexture(tex, rect, sur->pixels, sur->pitch))
+				throw std::runtime_error("Failed to update texture.");
+			return true;
+		}
+
+		/** Swaps in the pixels of bmps that changed on disk. Textures are
+		 * updated in place when the size is unchanged, so every Texture 
+		 * and TextureHandle sees the new pixels. Otherwise the cache gets
+		 * a new texture, which handles and later lookups resolve to.
+		 * @throws std::runtime_error on failure. */
+		void process_reloads() {
+			std::deque<DecodedSurface> items;
+			{
+				std::lock_guard lock(decoded_mutex);
+				items.swap(reloaded);
+			}
+			for (auto& item : items) {
+				auto& entry = textures[item.id];
+				SDL_Surface* sur = item.sur.get();
+				if (entry.region.tex &&
+					!update_texture(entry.region.tex.get(), &entry.region.src, sur))
+					SDL2_BASE_LOG_WARN("Reloaded bmp no longer fits its atlas region: {}", entry.path);
+				if (entry.tex && !update_texture(entry.tex.get(), nullptr, sur)) {
+					cache_stats.resident_bytes -= entry.bytes;
+					store_texture(item.id, create_texture(sur));
+				}
+				if (entry.tex || entry.region.tex) {
+					cache_stats.reloads++;
+					SDL2_BASE_LOG_DEBUG("Texture reloaded for bmp: {}", entry.path);
+				}
+			}
+		}
+
+		/** Releases least recently used textures that are owned only by 
+		 * the cache until the resident size fits the budget. 
+		 * @param keep A TextureId that must not be evicted. */
+		void evict(TextureId keep) {
+			TextureId id = textures.least_recent();
+			while (cache_stats.resident_bytes > cache_stats.budget &&
+				id != TextureCache::none) {
+				TextureId next = textures.more_recent(id);
+				auto& entry = textures[id];
+				if (id != keep && !entry.handles && entry.tex.use_count() == 1) {
+					cache_stats.resident_bytes -= entry.bytes;
+					cache_stats.evictions++;
+					entry.tex.reset();
+					entry.generation++;
+					entry.bytes = 0;
+					textures.unlink(id);
+					SDL2_BASE_LOG_DEBUG("Texture evicted for bmp: {}", entry.path);
+				}
+				id = next;
+			}
+		}
+
+		/** Returns a 1x1 magenta texture shown while loads are pending.
+		 * @throws std::runtime_error on failure. */
+		Texture get_placeholder() {
+			if (placeholder)
+				return placeholder;
+			Texture tex(
+				SDL_CreateTexture(
+					ren.get(), SDL_PIXELFORMAT_ARGB8888,
+					SDL_TEXTUREACCESS_STATIC, 1, 1),
+				[](SDL_Texture* t){ if (t) SDL_DestroyTexture(t); }
+			);
+			Uint32 magenta = 0xFFFF00FF;
+			if (!tex || SDL_UpdateTexture(tex.get(), nullptr, &magenta, 4))
+				throw std::runtime_error("Failed to create placeholder texture.");
+			placeholder = tex;
+			return placeholder;
+		}
+
+		/** Creates a Texture from a surface.
+		 * @param sur The surface.
+		 * @throws std::runtime_error on failure. */
+		Texture create_texture(SDL_Surface* sur) {
+			Texture tex(
+				[&](){
+					auto t = SDL_CreateTextureFromSurface(ren.get(), sur);
+					if (!t)
+						throw std::runtime_error("Failed to create texture.");
+					return t;
+				}(),
+				[](SDL_Texture* t){
+					if (t) SDL_DestroyTexture(t);
+					SDL2_BASE_LOG_DEBUG("Texture destroyed.");
+				}
+			);
+			if (load_config.premultiply_alpha && SDL_SetTextureBlendMode(tex.get(),
+				SDL_ComposeCustomBlendMode(
+					SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+					SDL_BLENDOPERATION_ADD,
+					SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+					SDL_BLENDOPERATION_ADD)))
+				throw std::runtime_error("Renderer doesn't support premultiplied alpha.");
+			return tex;
+		}
+
+		/** Submits indexed vertices in a single SDL_RenderGeometry call.
+		 * @param tex The texture or nullptr for untextured geometry.
+		 * @param vertices The vertices.
+		 * @param indices The indices into vertices.
+		 * @throws std::runtime_error on failure. */
+		void render_geometry(
+			SDL_Texture* tex,
+			std::span<const SDL_Vertex> vertices,
+			std::span<const int> indices
+		) SDL2_BASE_DRAW_NOEXCEPT {
+			if (indices.empty())
+				return;
+			SDL2_BASE_PROFILE_DRAW_CALL(tex);
+			SDL2_BASE_PROFILE_VERTICES(vertices.size());
+			if (SDL_RenderGeometry(
+				ren.get(), tex,
+				vertices.data(), static_cast<int>(vertices.size()),
+				indices.data(), static_cast<int>(indices.size()))
+			)
+				SDL2_BASE_DRAW_ERROR("Failed to render geometry.");
+		}
+
+		/** Submits a range of a Geometry's indices in a single 
+		 * SDL_RenderGeometry call.
+		 * @param tex The texture or nullptr for untextured geometry.
+		 * @param geo The geometry to submit.
+		 * @param first_index The first index of the range.
+		 * @param index_count The number of indices in the range.
+		 * @throws std::runtime_error on failure. */
+		void render_geometry(
+			SDL_Texture* tex,
+			const Geometry& geo,
+			std::size_t first_index,
+			std::size_t index_count
+		) SDL2_BASE_DRAW_NOEXCEPT {
+			render_geometry(
+				tex, geo.vertices,
+				std::span(geo.indices).subspan(first_index, index_count));
+		}
+
+		/** Returns the current draw blend mode of the renderer.
+		 * @throws std::runtime_error on failure. */
+		SDL_BlendMode get_draw_blend_mode() SDL2_BASE_DRAW_NOEXCEPT {
+			SDL_BlendMode blend {SDL_BLENDMODE_NONE};
+			if (SDL_GetRenderDrawBlendMode(ren.get(), &blend))
+				SDL2_BASE_DRAW_ERROR("Failed to get blend mode.");
+			return blend;
+		}
+
+		/** Records a texture draw into the frame's command buffer, keeping
+		 * the texture alive until the frame is submitted.
+		 * @throws std::runtime_error on failure. */
+		void record_texture(
+			const Texture& tex,
+			const SDL_Rect* srcrect,
+			const SDL_FRect* dstrect,
+			float angle,
+			SDL_RendererFlip flip
+		) {
+			if (frame_textures.empty() || frame_textures.back() != tex)
+				frame_textures.push_back(tex);
+			SDL_FRect dst;
+			if (dstrect) {
+				dst = *dstrect;
+			} else {
+				int w = 0, h = 0;
+				if (SDL_GetRendererOutputSize(ren.get(), &w, &h))
+					SDL2_BASE_DRAW_ERROR("Failed to get output size.");
+				dst = {0, 0, static_cast<float>(w), static_cast<float>(h)};
+			}
+			SDL_BlendMode blend {SDL_BLENDMODE_NONE};
+			if (SDL_GetTextureBlendMode(tex.get(), &blend))
+				SDL2_BASE_DRAW_ERROR("Failed to get blend mode.");
+			frame_commands.add_sprite(
+				tex.get(), srcrect, dst, angle, flip,
+				{255, 255, 255, 255}, layer, blend);
+		}
+
+		/** Submits and clears the frame's deferred commands.
+		 * @throws std::runtime_error on failure. */
+		void submit_frame() {
+			if (!frame_commands.empty())
+				submit(frame_commands);
+			frame_commands.clear();
+			frame_textures.clear();
+		}
+
+		/** Reads a capture target back and hands it to the workers.
+		 * @param i The index of the target.
+		 * @param index The number of the frame it holds.
+		 * @throws std::runtime_error on failure. */
+		void read_capture(std::size_t i, Uint64 index) {
+			FrameCapture& c = *capture;
+			std::vector<Uint8> buffer;
+			{
+				std::lock_guard lock(c.pool_mutex);
+				if (c.pending >= c.max_pending) {
+					c.dropped++;
+					return;
+				}
+				c.pending++;
+				if (!c.pool.empty()) {
+					buffer = std::move(c.pool.back());
+					c.pool.pop_back();
+				}
+			}
+			int pitch = c.w * 4;
+			buffer.resize(static_cast<std::size_t>(pitch) * static_cast<std::size_t>(c.h));
+			if (SDL_SetRenderTarget(ren.get(), c.targets[i].get()) ||
+				SDL_RenderReadPixels(
+					ren.get(), nullptr, SDL_PIXELFORMAT_ARGB8888, buffer.data(), pitch)) {
+				std::lock_guard lock(c.pool_mutex);
+				c.pending--;
+				throw std::runtime_error("Failed to read captured frame.");
+			}
+			c.workers.submit([&c, buffer = std::move(buffer), pitch, index]() mutable {
+				c.callback({buffer, c.w, c.h, pitch, index});
+				c.captured.fetch_add(1, std::memory_order_relaxed);
+				std::lock_guard lock(c.pool_mutex);
+				c.pool.push_back(std::move(buffer));
+				c.pending--;
+			});
+		}
+
+		/** Shows the frame rendered into the current capture target, 
+		 * reads back the oldest one and starts the next frame.
+		 * @throws std::runtime_error on failure. */
+		void present_capture() {
+			FrameCapture& c = *capture;
+			if (SDL_SetRenderTarget(ren.get(), nullptr) ||
+				SDL_RenderCopy(ren.get(), c.targets[c.current].get(), nullptr, nullptr))
+				throw std::runtime_error("Failed to show captured frame.");
+			SDL_RenderPresent(ren.get());
+			c.rendered++;
+			c.current = (c.current + 1) % c.targets.size();
+			// The next target holds the frame rendered targets.size() - 1
+			// frames ago, which has most likely finished on the GPU.
+			if (c.rendered >= c.targets.size())
+				read_capture(c.current, c.rendered - c.targets.size());
+			if (SDL_SetRenderTarget(ren.get(), c.targets[c.current].get()))
+				throw std::runtime_error("Failed to set render target.");
+		}
+
+		/** Feeds the frame time to the quality controller.
+		 * @param work_end When the frame's work ended. */
+		void update_quality(Uint64 work_end) {
+			if (frame_start && quality->add_frame(
+				static_cast<double>(work_end - frame_start) * 1000.0 /
+				static_cast<double>(SDL_GetPerformanceFrequency())) && on_quality)
+				on_quality(quality->get_quality());
+			frame_start = SDL_GetPerformanceCounter();
+		}
+
+		/** Throws on a handle that was released or never acquired, in 
+		 * debug builds only.
+		 * @param handle The TextureHandle. */
+		void check_handle([[maybe_unused]] TextureHandle handle) const {
+#ifndef NDEBUG
+			if (is_stale(handle))
+				throw std::runtime_error("Stale texture handle.");
+#endif
+		}
+
+		/** Checks if a handle was released or never acquired.
+		 * @param handle The TextureHandle. */
+		bool is_stale(TextureHandle handle) const {
+			return handle.index >= textures.size() ||
+				!textures[handle.index].handles ||
+				textures[handle.index].generation != handle.generation;
+		}
+
+		/** Returns the texture of a handle for drawing like resolve, but
+		 * reports a stale handle (in debug builds) or a missing 
+		 * placeholder like the drawing functions report errors.
+		 * @param handle The TextureHandle.
+		 * @return The texture or nullptr after a recorded error.
+		 * @throws std::runtime_error on failure. */
+		SDL_Texture* resolve_draw(TextureHandle handle) SDL2_BASE_DRAW_NOEXCEPT {
+#ifndef NDEBUG
+			if (is_stale(handle)) {
+				SDL2_BASE_DRAW_ERROR("Stale texture handle.");
+				return nullptr;
+			}
+#endif
+			SDL_Texture* tex = textures[handle.index].tex.get();
+			if (!tex) {
+				SDL2_BASE_RECORD_DRAW(tex = get_placeholder().get());
+			}
+			return tex;
+		}
+
+		/** Submits a Geometry in a single SDL_RenderGeometry call.
+		 * @param tex The texture or nullptr for untextured geometry.
+		 * @param geo The geometry to submit.
+		 * @throws std::runtime_error on failure. */
+		void render_geometry(SDL_Texture* tex, const Geometry& geo) SDL2_BASE_DRAW_NOEXCEPT {
+			render_geometry(tex, geo, 0, geo.indices.size());
+		}
+
+		public:
+
+		/** Constructor of the Base class.
+		 * @param init_flags SDL2 init flag(s) separated by '|'.
+		 * @param title The window title. 
+		 * @param w The width of the window.
+		 * @param h the height of the window.
+		 * @param win_flags SDL2 window flag(s) separated by '|'.
+		 * @param ren_flags SDL2 renderer flag(s) separated by '|'.
+		 * @throws std::runtime_error on failure. */
+		Base(
+			Uint32 init_flags,
+			std::string_view title,
+			int w, int h,
+			Uint32 win_flags,
+			Uint32 ren_flags
+		) :
+			sdl(init_flags),
+			win(
+				[&]() {
+					auto wi =
+						SDL_CreateWindow(title.data(), 0, 0, w, h, win_flags);
+					if (!wi)
+						throw std::runtime_error("Failed to create window.");
+					SDL2_BASE_LOG_DEBUG("Window created.");
+					return wi;
+				}(),
+				[](SDL_Window* w) {
+					if (w) SDL_DestroyWindow(w);
+					SDL2_BASE_LOG_DEBUG("Window destroyed.");
+				}
+			),
+			ren(
+				[&](){
+					auto r = SDL_CreateRenderer(win.get(), -1, ren_flags);
+					if (!r)
+						throw std::runtime_error("Failed to create renderer.");
+					SDL2_BASE_LOG_DEBUG("Renderer created.");
+					return r;
 				}(),
-				[](SDL_Window* w) {
-					if (w) SDL_DestroyWindow(w);
-					DBGMSG("Window destroyed.");
+				[](SDL_Renderer* r) {
+					if (r) SDL_DestroyRenderer(r);
+					SDL2_BASE_LOG_DEBUG("Renderer destroyed.");
 				}
+			)
+		{}
+
+		/** Headless constructor of the Base class. Renders with the 
+		 * software renderer into an ARGB8888 surface instead of a window,
+		 * e.g. for generating images on servers or in CI.
+		 * @param w The width of the surface.
+		 * @param h The height of the surface.
+		 * @param init_flags SDL2 init flag(s) separated by '|'. 
+		 * Neither video nor a display is needed.
+		 * @throws std::runtime_error on failure. */
+		Base(Headless, int w, int h, Uint32 init_flags = SDL_INIT_EVENTS) :
+			sdl(init_flags),
+			win(nullptr, SDL_DestroyWindow),
+			canvas(
+				[&](){
+					auto s = SDL_CreateRGBSurfaceWithFormat(
+						0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+					if (!s)
+						throw std::runtime_error("Failed to create surface.");
+					return s;
+				}(),
+				SDL_FreeSurface
 			),
 			ren(
 				[&](){
-					auto r = SDL_CreateRenderer(win.get(), -1, ren_flags);
+					auto r = SDL_CreateSoftwareRenderer(canvas.get());
 					if (!r)
 						throw std::runtime_error("Failed to create renderer.");
-					DBGMSG("Renderer created.");
+					SDL2_BASE_LOG_DEBUG("Headless renderer created.");
 					return r;
 				}(),
 				[](SDL_Renderer* r) {
 					if (r) SDL_DestroyRenderer(r);
-					DBGMSG("Renderer destroyed.");
+					SDL2_BASE_LOG_DEBUG("Renderer destroyed.");
 				}
 			)
 		{}
 
+		/** Checks if the Base renders into a surface instead of a window.
+		 * @return A boolean indicating the result. */
+		bool is_headless() const {
+			return canvas != nullptr;
+		}
+
+		/** Copies rendered pixels from the current render target.
+		 * @param pixels Receives the pixels, at least pitch times the 
+		 * height of the area bytes.
+		 * @param pitch The length of a row in pixels in bytes.
+		 * @param rect The area to read or nullptr for the whole target.
+		 * @param format The pixel format to read in.
+		 * @throws std::runtime_error on failure. */
+		void read_pixels(
+			std::span<Uint8> pixels,
+			int pitch,
+			const SDL_Rect* rect = nullptr,
+			Uint32 format = SDL_PIXELFORMAT_ARGB8888
+		) {
+			int h = 0;
+			if (rect)
+				h = rect->h;
+			else if (SDL_GetRendererOutputSize(ren.get(), nullptr, &h))
+				throw std::runtime_error("Failed to get output size.");
+			if (pixels.size() < static_cast<std::size_t>(pitch) * static_cast<std::size_t>(h))
+				throw std::runtime_error("Pixel buffer too small.");
+			if (SDL_RenderReadPixels(ren.get(), rect, format, pixels.data(), pitch))
+				throw std::runtime_error("Failed to read pixels.");
+		}
+
+		/** Reads the current render target now and saves it as a bmp on a
+		 * worker thread. SDL2 can only write bmps; encoding to png needs
+		 * SDL_image's IMG_SavePNG.
+		 * @param path Path of the bmp to write.
+		 * @return Whether the bmp was written, once it was.
+		 * @throws std::runtime_error on failure to read the pixels. */
+		std::future<bool> save_bmp_async(std::string path) {
+			int w, h;
+			if (SDL_GetRendererOutputSize(ren.get(), &w, &h))
+				throw std::runtime_error("Failed to get output size.");
+			auto pixels = std::make_shared<std::vector<Uint8>>(
+				static_cast<std::size_t>(w) * static_cast<std::size_t>(h) * 4);
+			read_pixels(*pixels, w * 4);
+			auto done = std::make_shared<std::promise<bool>>();
+			auto result = done->get_future();
+			if (!encoder)
+				encoder = std::make_unique<ThreadPool>(1);
+			encoder->submit([pixels, done, w, h, path = std::move(path)]{
+				Surface sur(
+					SDL_CreateRGBSurfaceWithFormatFrom(
+						pixels->data(), w, h, 32, w * 4, SDL_PIXELFORMAT_ARGB8888),
+					[](SDL_Surface* s){ if (s) SDL_FreeSurface(s); }
+				);
+				done->set_value(sur && !SDL_SaveBMP(sur.get(), path.c_str()));
+			});
+			return result;
+		}
+
+		/** Starts capturing every presented frame. From now on frames are
+		 * rendered into a ring of target textures, copied to the screen in
+		 * present and read back when the ring comes around to them.
+		 * The size of the output is fixed for the capture.
+		 * @param callback Called with each frame on a worker thread, 
+		 * possibly concurrently and out of order with more than one worker.
+		 * @param buffers The number of target textures; frame n is read 
+		 * back while frame n + buffers - 1 is being rendered.
+		 * @param workers The number of worker threads, 0 for one less 
+		 * than the number of hardware threads.
+		 * @param max_pending Frames waiting for the workers beyond this 
+		 * are dropped.
+		 * @throws std::runtime_error on failure. */
+		void start_capture(
+			CaptureCallback callback,
+			std::size_t buffers = 3,
+			unsigned workers = 0,
+			std::size_t max_pending = 8
+		) {
+			stop_capture();
+			int w, h;
+			if (SDL_GetRendererOutputSize(ren.get(), &w, &h))
+				throw std::runtime_error("Failed to get output size.");
+			std::vector<Texture> targets;
+			for (std::size_t i = 0; i < std::max<std::size_t>(buffers, 1); i++) {
+				targets.emplace_back(
+					SDL_CreateTexture(
+						ren.get(), SDL_PIXELFORMAT_ARGB8888,
+						SDL_TEXTUREACCESS_TARGET, w, h),
+					[](SDL_Texture* t){
+						if (t) SDL_DestroyTexture(t);
+						SDL2_BASE_LOG_DEBUG("Capture target destroyed.");
+					}
+				);
+				if (!targets.back())
+					throw std::runtime_error("Failed to create capture target.");
+			}
+			capture.reset(new FrameCapture(
+				std::move(targets), w, h, std::move(callback),
+				std::max<std::size_t>(max_pending, 1), workers));
+			if (SDL_SetRenderTarget(ren.get(), capture->targets[0].get())) {
+				capture.reset();
+				throw std::runtime_error("Failed to set render target.");
+			}
+			SDL2_BASE_LOG_DEBUG("Capture started.");
+		}
+
+		/** Stops capturing. Frames presented but not yet read back are
+		 * read now and all callbacks have returned when this returns.
+		 * @throws std::runtime_error on failure. */
+		void stop_capture() {
+			if (!capture)
+				return;
+			FrameCapture& c = *capture;
+			std::size_t n = c.targets.size();
+			for (std::size_t k = 1; k < n; k++)
+				if (c.rendered + k >= n)
+					read_capture((c.current + k) % n, c.rendered + k - n);
+			SDL_SetRenderTarget(ren.get(), nullptr);
+			capture.reset();
+			SDL2_BASE_LOG_DEBUG("Capture stopped.");
+		}
+
+		/** Returns the running capture or nullptr. */
+		const FrameCapture* get_capture() const {
+			return capture.get();
+		}
+
 		/** Set renderer draw color.
 		 * @param col RGBA color.
 		 * @throws std::runtime_error on failure. */
-		void set_draw_color(SDL_Color col) {
+		void set_draw_color(SDL_Color col) SDL2_BASE_DRAW_NOEXCEPT {
 			if (SDL_SetRenderDrawColor(ren.get(), col.r, col.g, col.b, col.a))
-				throw std::runtime_error("Failed to set draw color.");
+				SDL2_BASE_DRAW_ERROR("Failed to set draw color.");
+		}
+
+		/** Restricts drawing to a rectangle of the current target.
+		 * @param rect The clip rectangle or nullptr to disable clipping.
+		 * @throws std::runtime_error on failure. */
+		void set_clip_rect(const SDL_Rect* rect) SDL2_BASE_DRAW_NOEXCEPT {
+			if (SDL_RenderSetClipRect(ren.get(), rect))
+				SDL2_BASE_DRAW_ERROR("Failed to set clip rect.");
+		}
+
+		/** Returns the clip rectangle or std::nullopt if clipping is off. */
+		std::optional<SDL_Rect> get_clip_rect() {
+			if (!SDL_RenderIsClipEnabled(ren.get()))
+				return std::nullopt;
+			SDL_Rect rect;
+			SDL_RenderGetClipRect(ren.get(), &rect);
+			return rect;
 		}
 
 		/** Clear renderer.
 		 * @throws std::runtime_error on failure. */
-		void clear() {
+		void clear() SDL2_BASE_DRAW_NOEXCEPT {
+			SDL2_BASE_PROFILE_SCOPE(CLEAR);
 			if (SDL_RenderClear(ren.get()))
-				throw std::runtime_error("Failed to clear renderer.");
+				SDL2_BASE_DRAW_ERROR("Failed to clear renderer.");
 		}
 
-		/** Presents the renderer. */
+		/** Submits deferred draws, presents the renderer, then uploads
+		 * pending asynchronously loaded textures within the upload budget
+		 * and swaps in hot reloaded ones. Finally resets the frame arena.
+		 * @throws std::runtime_error if submission or a texture upload 
+		 * fails. */
 		void present() {
-			SDL_RenderPresent(ren.get());
+			if (deferred)
+				submit_frame();
+			Uint64 work_end = quality ? SDL_GetPerformanceCounter() : 0;
+			{
+				SDL2_BASE_PROFILE_SCOPE(PRESENT);
+				{
+					SDL2_BASE_PROFILE_PRESENT();
+					if (capture)
+						present_capture();
+					else
+						SDL_RenderPresent(ren.get());
+				}
+				if (pending_loads)
+					process_uploads(upload_budget);
+				if (watcher)
+					process_reloads();
+			}
+			SDL2_BASE_PROFILE_END_FRAME();
+			frame_arena.reset();
+#ifdef SDL2_BASE_RECORD_ERRORS
+			frame_errors = std::exchange(draw_errors, {0, nullptr});
+#endif
+			if (quality)
+				update_quality(work_end);
+		}
+
+		/** Starts adapting the quality factor to the frame time. Frames 
+		 * are timed from the end of a present to the start of the next 
+		 * SDL_RenderPresent, so waiting for vsync doesn't count.
+		 * SDL2 has no GPU timers, so a GPU bound frame only shows up 
+		 * through the CPU waiting on the renderer.
+		 * @param config The QualityConfig.
+		 * @param on_change Called by present with the new quality factor 
+		 * whenever it changes, for example to render into a smaller Layer
+		 * or to lower ParticleSystem limits. */
+		void start_adaptive_quality(
+			const QualityConfig& config = {},
+			std::function<void(float)> on_change = nullptr
+		) {
+			quality.emplace(config);
+			on_quality = std::move(on_change);
+			frame_start = 0;
+		}
+
+		/** Stops adapting the quality factor, which returns to 1. */
+		void stop_adaptive_quality() {
+			quality.reset();
+			on_quality = nullptr;
+		}
+
+		/** Returns the quality factor between QualityConfig::min_quality
+		 * and 1, or 1 if adaptive quality is off. */
+		float get_quality() const {
+			return quality ? quality->get_quality() : 1.0f;
+		}
+
+		/** Returns the quality controller or nullptr if adaptive quality 
+		 * is off. */
+		const QualityController* get_quality_controller() const {
+			return quality ? &*quality : nullptr;
 		}
 
 		/** Checks if the texture was loaded.
 		 * @param bmp Path to the bmp.
 		 * @return a boolean indicating the result. */
-		bool is_texture_loaded(std::string_view bmp) {
-			auto tex = textures_map.find(std::string(bmp));
-			return tex != textures_map.end();
+		bool is_texture_loaded(std::string_view bmp) const {
+			auto id = textures.find(bmp);
+			return id && textures[*id].tex;
 		}
 
-		/** Creates a Texture from a bmp file and stores the path and the 
-		 * resulting texture in a std::map. 
+		/** Interns a bmp path without loading it. The returned id gives
+		 * O(1) access through the TextureId overloads.
+		 * @param bmp Path to the bmp.
+		 * @return The TextureId of the bmp. */
+		TextureId intern_texture(std::string_view bmp) {
+			return textures.intern(bmp);
+		}
+
+		/** Creates a Texture from a bmp file and stores it in the texture 
+		 * cache. Does nothing if the texture has already been loaded.
 		 * @param path_to_bmp Path to the bmp file. 
 		 * @throws std::runtime_error on failure. */
 		void load_texture(std::string_view path_to_bmp) {
-			if (is_texture_loaded(path_to_bmp)) {
-				DBGMSG("Texture has already been loaded for bmp:");
-				DBGMSG(path_to_bmp);
+			load_texture(textures.intern(path_to_bmp));
+		}
+
+		/** Creates a Texture for an interned bmp path.
+		 * Does nothing if the texture has already been loaded.
+		 * @param id The TextureId of the bmp.
+		 * @throws std::runtime_error on failure. */
+		void load_texture(TextureId id) {
+			auto& entry = textures[id];
+			if (entry.tex || entry.pending) {
+				SDL2_BASE_LOG_DEBUG("Texture has already been loaded for bmp: {}", entry.path);
+				return;
 			}
-			Surface sur(
-				[&](){
-					auto s = SDL_LoadBMP(path_to_bmp.data());
-					if (!s) throw std::runtime_error("Failed to load bmp.");
-					DBGMSG("Texture created from bmp:");
-					DBGMSG(path_to_bmp);
-					return s;
-				}(),
-				[](SDL_Surface* s){
-					if (s) SDL_FreeSurface(s);
-					DBGMSG("Surface freed.");
-				}
-			);
-			Texture tex(
-				[&](){
-					auto t =
-						SDL_CreateTextureFromSurface(ren.get(), sur.get());
-					if (!t)
-						throw std::runtime_error("Failed to create texture.");
-					return t;
-				}(),
-				[](SDL_Texture* t){
-					if (t) SDL_DestroyTexture(t);
-					DBGMSG("Texture destroyed.");
+			cache_stats.misses++;
+			if (entry.archive) {
+				store_texture(id, create_archive_texture(entry));
+			} else {
+				Surface sur = load_converted_surface(entry.path, get_texture_format());
+				store_texture(id, create_texture(sur.get()));
+			}
+			SDL2_BASE_LOG_DEBUG("New texture stored in the texture cache.");
+		}
+
+		/** Maps a packed archive written by Archive::pack. Its bmps are 
+		 * then loaded from the mapping instead of the filesystem.
+		 * @param path_to_archive Path to the archive.
+		 * @throws std::runtime_error on failure. */
+		void mount_archive(std::string_view path_to_archive) {
+			archives.push_back(
+				std::make_unique<Archive>(std::string(path_to_archive)));
+			const Archive& archive = *archives.back();
+			auto records = archive.get_records();
+			for (std::size_t i = 0; i < records.size(); i++) {
+				auto& entry = textures[textures.intern(archive.get_path(records[i]))];
+				entry.archive = &archive;
+				entry.record = static_cast<Uint32>(i);
+			}
+			SDL2_BASE_LOG_DEBUG("Archive mounted.");
+		}
+
+		/** Starts loading a bmp on the loader threads. Only the texture 
+		 * upload happens on the calling thread, in present or 
+		 * process_uploads. Until then get_texture returns a placeholder.
+		 * @param path_to_bmp Path to the bmp file.
+		 * @return The TextureId of the bmp. */
+		TextureId load_texture_async(std::string_view path_to_bmp) {
+			TextureId id = textures.intern(path_to_bmp);
+			auto& entry = textures[id];
+			if (entry.tex || entry.pending)
+				return id;
+			entry.pending = true;
+			pending_loads++;
+			if (entry.archive) {
+				// Nothing to decode, the upload reads the mapping.
+				std::lock_guard lock(decoded_mutex);
+				decoded.push_back({id, Surface(nullptr, SDL_FreeSurface)});
+				return id;
+			}
+			if (!loader)
+				loader = std::make_unique<ThreadPool>();
+			loader->submit([this, id, path = entry.path,
+				format = get_texture_format(), config = load_config]{
+				Surface sur = decode_surface(path, format, config);
+				std::lock_guard lock(decoded_mutex);
+				decoded.push_back({id, std::move(sur)});
+			});
+			return id;
+		}
+
+		/** Uploads asynchronously decoded surfaces to textures. 
+		 * At least one surface is uploaded if any is ready.
+		 * Textures that failed to decode are retried synchronously (and 
+		 * throw) on the next get_texture.
+		 * @param byte_budget Stop once this many bytes have been uploaded.
+		 * @return The number of textures uploaded.
+		 * @throws std::runtime_error on failure. */
+		std::size_t process_uploads(std::size_t byte_budget = SIZE_MAX) {
+			std::size_t uploaded = 0, bytes = 0;
+			while (true) {
+				DecodedSurface item {0, Surface(nullptr, SDL_FreeSurface)};
+				{
+					std::lock_guard lock(decoded_mutex);
+					if (decoded.empty())
+						break;
+					item = std::move(decoded.front());
+					decoded.pop_front();
 				}
-			);
-			auto pair = textures_map.emplace(path_to_bmp, tex);
-			if (!pair.second)
-				throw std::runtime_error("Failed to emplace into textures_map.");
-			DBGMSG("New texture emplaced into textures_map.");
+				auto& entry = textures[item.id];
+				entry.pending = false;
+				pending_loads--;
+				if (!entry.archive && !item.sur)
+					continue;
+				bytes += store_texture(item.id, entry.archive ?
+					create_archive_texture(entry) :
+					create_texture(item.sur.get()));
+				uploaded++;
+				if (bytes >= byte_budget)
+					break;
+			}
+			return uploaded;
+		}
+
+		/** Sets the pixel processing of bmps loaded from now on.
+		 * @param config The LoadConfig. */
+		void set_load_config(const LoadConfig& config) {
+			load_config = config;
+		}
+
+		/** Returns the format loaded bmps are converted to: ARGB8888 
+		 * if the renderer supports it, otherwise its preferred format. */
+		Uint32 get_texture_format() {
+			if (texture_format != SDL_PIXELFORMAT_UNKNOWN)
+				return texture_format;
+			texture_format = SDL_PIXELFORMAT_ARGB8888;
+			SDL_RendererInfo info;
+			if (!SDL_GetRendererInfo(ren.get(), &info) && info.num_texture_formats &&
+				std::find(info.texture_formats,
+					info.texture_formats + info.num_texture_formats,
+					Uint32(SDL_PIXELFORMAT_ARGB8888)) ==
+					info.texture_formats + info.num_texture_formats)
+				texture_format = info.texture_formats[0];
+			return texture_format;
+		}
+
+		/** Sets how many bytes present may upload per frame.
+		 * @param bytes The budget, SIZE_MAX for no limit. */
+		void set_upload_budget(std::size_t bytes) {
+			upload_budget = bytes;
+		}
+
+		/** Bounds the memory of the standalone textures in the cache. 
+		 * Least recently used textures that nothing else holds are 
+		 * evicted and transparently reloaded by the next get_texture.
+		 * @param bytes The budget, SIZE_MAX for no limit. */
+		void set_texture_budget(std::size_t bytes) {
+			cache_stats.budget = bytes;
+			evict(TextureCache::none);
+		}
+
+		/** Starts hot reloading: loose bmps of loaded textures and atlas
+		 * regions are watched, and when one is saved it is decoded on the
+		 * watcher thread with the current LoadConfig and swapped in by 
+		 * present. Only supported on Linux.
+		 * @throws std::runtime_error on failure or if file watching is
+		 * not supported on this platform. */
+		void watch_textures() {
+			if (watcher)
+				return;
+			watcher = std::make_unique<FileWatcher>(
+				[this, format = get_texture_format(), config = load_config](
+					Uint32 id, const std::string& path) {
+				Surface sur = decode_surface(path, format, config);
+				// A file that is still being written fails to decode and is
+				// picked up by the event of the next write.
+				if (!sur)
+					return;
+				std::lock_guard lock(decoded_mutex);
+				reloaded.push_back({id, std::move(sur)});
+			});
+			for (TextureId id = 0; id < textures.size(); id++)
+				if (textures[id].tex || textures[id].region.tex)
+					watch_texture(id);
+		}
+
+		/** Stops hot reloading. Reloads that were already decoded are 
+		 * swapped in first.
+		 * @throws std::runtime_error on failure. */
+		void unwatch_textures() {
+			if (!watcher)
+				return;
+			watcher.reset();
+			process_reloads();
+			for (TextureId id = 0; id < textures.size(); id++)
+				textures[id].watched = false;
+		}
+
+		/** Loads a bmp if needed and pins it in the cache for drawing 
+		 * through a TextureHandle.
+		 * @param path_to_bmp Path to the bmp file.
+		 * @return The TextureHandle, valid until released.
+		 * @throws std::runtime_error on failure. */
+		TextureHandle acquire_texture(std::string_view path_to_bmp) {
+			return acquire_texture(textures.intern(path_to_bmp));
+		}
+
+		/** Loads a bmp if needed and pins it in the cache for drawing 
+		 * through a TextureHandle.
+		 * @param id The TextureId of the bmp.
+		 * @return The TextureHandle, valid until released.
+		 * @throws std::runtime_error on failure. */
+		TextureHandle acquire_texture(TextureId id) {
+			load_texture(id);
+			auto& entry = textures[id];
+			entry.handles++;
+			textures.touch(id);
+			return {id, entry.generation};
+		}
+
+		/** Releases a handle. Once all handles of a texture are released 
+		 * it may be evicted under the texture budget. In deferred mode 
+		 * release handles only after the frames that draw them.
+		 * @param handle The TextureHandle.
+		 * @throws std::runtime_error on a stale handle in debug builds. */
+		void release_texture(TextureHandle handle) {
+			check_handle(handle);
+			textures[handle.index].handles--;
+			evict(TextureCache::none);
+		}
+
+		/** Returns the texture of a handle, or the placeholder while an
+		 * asynchronous load is pending. No reference count is touched.
+		 * @param handle The TextureHandle.
+		 * @return The texture, alive until the handle is released.
+		 * @throws std::runtime_error on a stale handle in debug builds. */
+		SDL_Texture* resolve(TextureHandle handle) {
+			check_handle(handle);
+			SDL_Texture* tex = textures[handle.index].tex.get();
+			return tex ? tex : get_placeholder().get();
+		}
+
+		/** Returns the hit, miss and eviction counters of the texture 
+		 * cache. */
+		TextureCacheStats get_texture_cache_stats() const {
+			return cache_stats;
+		}
+
+		/** Returns the number of asynchronous loads not yet uploaded. */
+		std::size_t get_pending_loads() const {
+			return pending_loads;
+		}
+
+		/** Checks if the texture of an interned bmp is ready to draw.
+		 * @param id The TextureId of the bmp.
+		 * @return A boolean indicating the result. */
+		bool is_texture_ready(TextureId id) const {
+			return textures[id].tex != nullptr;
 		}
 
 		/** Returns a shared pointer to a Texture. 
@@ -279,74 +4790,841 @@ namespace SDL2_Base {
 		 * @return The Texture.
 		 * @throws std::runtime_error on failure. */
 		Texture get_texture(std::string_view bmp) {
-			auto tex = textures_map.find(std::string(bmp));
-			if (tex == textures_map.end()) {
-				load_texture(bmp);
-				tex = textures_map.find(std::string(bmp));
+			return get_texture(textures.intern(bmp));
+		}
+
+		/** Returns a shared pointer to the Texture of an interned bmp path.
+		 * It loads the texture lazily if it hasn't been loaded before.
+		 * @param id The TextureId of the bmp.
+		 * @return The Texture.
+		 * @throws std::runtime_error on failure. */
+		Texture get_texture(TextureId id) {
+			auto& entry = textures[id];
+			if (!entry.tex) {
+				if (entry.pending)
+					return get_placeholder();
+				load_texture(id);
+			} else {
+				cache_stats.hits++;
+				textures.touch(id);
+			}
+			SDL2_BASE_LOG_TRACE("Texture found for bmp: {}", entry.path);
+			return entry.tex;
+		}
+
+		/** Packs bmps into as few atlas textures as possible.
+		 * The regions can be retrieved with get_region.
+		 * Bmps that are already part of an atlas are skipped.
+		 * @param bmps Paths to the bmps.
+		 * @param page_size The width and maximum height of an atlas page.
+		 * @param padding Empty pixels between regions to avoid bleeding.
+		 * @throws std::runtime_error on failure. */
+		void build_atlas(
+			std::span<const std::string_view> bmps,
+			int page_size = 2048,
+			int padding = 1
+		) {
+			std::vector<std::string_view> paths;
+			std::vector<Surface> surfaces;
+			for (auto bmp : bmps) {
+				auto id = textures.find(bmp);
+				if ((id && textures[*id].region.tex) ||
+					std::find(paths.begin(), paths.end(), bmp) != paths.end())
+					continue;
+				surfaces.push_back(load_converted_surface(bmp, SDL_PIXELFORMAT_ARGB8888));
+				paths.push_back(bmp);
+				if (surfaces.back()->w + padding > page_size ||
+					surfaces.back()->h + padding > page_size)
+					throw std::runtime_error("Bmp does not fit into an atlas page.");
 			}
-			DBGMSG("Texture found for bmp:");
-			DBGMSG(bmp);
-			return tex->second;
+
+			std::vector<std::size_t> order(surfaces.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::sort(order.begin(), order.end(), [&](auto a, auto b) {
+				if (surfaces[a]->h != surfaces[b]->h)
+					return surfaces[a]->h > surfaces[b]->h;
+				return surfaces[a]->w > surfaces[b]->w;
+			});
+
+			struct Placement {
+				std::size_t surface;
+				SDL_Rect rect;
+			};
+			std::vector<std::vector<Placement>> pages;
+			std::vector<SkylinePacker> packers;
+			for (auto i : order) {
+				int w = surfaces[i]->w + padding, h = surfaces[i]->h + padding;
+				std::optional<SDL_Rect> rect;
+				std::size_t p = 0;
+				for (; p < packers.size(); p++)
+					if ((rect = packers[p].insert(w, h)))
+						break;
+				if (!rect) {
+					packers.emplace_back(page_size, page_size);
+					pages.emplace_back();
+					rect = packers.back().insert(w, h);
+				}
+				pages[p].push_back({i, *rect});
+			}
+
+			long long used = 0, total = 0;
+			for (std::size_t p = 0; p < pages.size(); p++) {
+				int page_h = packers[p].get_used_height();
+				Surface page(
+					SDL_CreateRGBSurfaceWithFormat(
+						0, page_size, page_h, 32, SDL_PIXELFORMAT_ARGB8888),
+					[](SDL_Surface* s){
+						if (s) SDL_FreeSurface(s);
+					}
+				);
+				if (!page)
+					throw std::runtime_error("Failed to create atlas page.");
+				for (auto& placement : pages[p]) {
+					SDL_Surface* src = surfaces[placement.surface].get();
+					placement.rect.w = src->w;
+					placement.rect.h = src->h;
+					SDL_SetSurfaceBlendMode(src, SDL_BLENDMODE_NONE);
+					SDL_Rect dst = placement.rect;
+					if (SDL_BlitSurface(src, nullptr, page.get(), &dst))
+						throw std::runtime_error("Failed to blit into atlas page.");
+				}
+				Texture tex = create_texture(page.get());
+				for (const auto& placement : pages[p]) {
+					auto id = textures.intern(paths[placement.surface]);
+					textures[id].region = {tex, placement.rect};
+					watch_texture(id);
+				}
+				atlas_regions += pages[p].size();
+				atlas_pages.push_back(tex);
+				used += packers[p].get_used_area();
+				total += static_cast<long long>(page_size) * page_h;
+			}
+
+			atlas_stats.pages = atlas_pages.size();
+			atlas_stats.regions = atlas_regions;
+			atlas_used_area += used;
+			atlas_total_area += total;
+			atlas_stats.occupancy = atlas_total_area ?
+				static_cast<double>(atlas_used_area) /
+				static_cast<double>(atlas_total_area) : 0;
+			SDL2_BASE_LOG_DEBUG("Atlas built.");
+		}
+
+		/** Returns the region of a bmp, either inside an atlas page built by
+		 * build_atlas or covering a whole standalone texture, which is 
+		 * loaded lazily if needed.
+		 * @param bmp Path to the bmp.
+		 * @return The TextureRegion.
+		 * @throws std::runtime_error on failure. */
+		TextureRegion get_region(std::string_view bmp) {
+			return get_region(textures.intern(bmp));
+		}
+
+		/** Returns the region of an interned bmp path.
+		 * @param id The TextureId of the bmp.
+		 * @return The TextureRegion.
+		 * @throws std::runtime_error on failure. */
+		TextureRegion get_region(TextureId id) {
+			if (textures[id].region.tex)
+				return textures[id].region;
+			TextureRegion result {get_texture(id), {0, 0, 0, 0}};
+			if (SDL_QueryTexture(
+				result.tex.get(), nullptr, nullptr,
+				&result.src.w, &result.src.h)
+			)
+				throw std::runtime_error("Failed to query texture.");
+			return result;
+		}
+
+		/** Loads a bitmap font from a sheet of glyph cells through the
+		 * texture cache, from an atlas if the sheet was packed into one.
+		 * @param path_to_bmp Path to the sheet.
+		 * @param glyph_w The width of a glyph cell.
+		 * @param glyph_h The height of a glyph cell.
+		 * @param first The character of the first cell.
+		 * @return The Font.
+		 * @throws std::runtime_error on failure. */
+		Font load_font(
+			std::string_view path_to_bmp,
+			int glyph_w, int glyph_h,
+			unsigned char first = ' '
+		) {
+			if (glyph_w <= 0 || glyph_h <= 0)
+				throw std::runtime_error("Invalid glyph size.");
+			TextureRegion sheet = get_region(path_to_bmp);
+			int w, h;
+			if (SDL_QueryTexture(sheet.tex.get(), nullptr, nullptr, &w, &h))
+				throw std::runtime_error("Failed to query texture.");
+			return Font(std::move(sheet), w, h, glyph_w, glyph_h, first);
+		}
+
+		/** Returns occupancy information of the atlas pages for tuning
+		 * the page size.
+		 * @return The AtlasStats. */
+		AtlasStats get_atlas_stats() const {
+			return atlas_stats;
+		}
+
+		/** Turns deferred mode on or off. In deferred mode the draw 
+		 * overloads record into a command buffer on the current layer, 
+		 * which present sorts and submits. Textures drawn are kept alive 
+		 * until then.
+		 * @param on Whether to defer draws. 
+		 * @throws std::runtime_error if pending draws fail to submit 
+		 * when turning deferred mode off. */
+		void set_deferred(bool on) {
+			if (deferred && !on)
+				submit_frame();
+			deferred = on;
+		}
+
+		/** Sets the layer deferred draws are recorded on. Lower layers are
+		 * drawn first.
+		 * @param layer The layer, clamped to the range of int16_t. */
+		void set_layer(int layer) {
+			this->layer = layer;
+		}
+
+		/** Sorts a command buffer if needed and submits it with one 
+		 * SDL_RenderGeometry call per run of commands sharing a texture
+		 * and blend mode. The blend modes of the textures and the 
+		 * renderer's draw blend mode are set to those of the commands.
+		 * @param buffer The command buffer, left intact for replaying.
+		 * @throws std::runtime_error on failure. */
+		void submit(CommandBuffer& buffer) {
+			SDL2_BASE_PROFILE_SCOPE(DRAW);
+			buffer.sort();
+			auto commands = buffer.get_commands();
+			auto& indices = geometry.indices;
+			for (std::size_t i = 0; i < commands.size();) {
+				Uint64 state = commands[i].key & 0xFFFFFF;
+				indices.clear();
+				for (; i < commands.size() && (commands[i].key & 0xFFFFFF) == state; i++) {
+					int first = static_cast<int>(commands[i].quad * 4);
+					indices.insert(indices.end(), {
+						first, first + 1, first + 2,
+						first, first + 2, first + 3
+					});
+				}
+				SDL_Texture* tex = buffer.get_texture(state);
+				SDL_BlendMode blend = buffer.get_blend_mode(state);
+				if (tex ? SDL_SetTextureBlendMode(tex, blend) :
+					SDL_SetRenderDrawBlendMode(ren.get(), blend))
+					throw std::runtime_error("Failed to set blend mode.");
+				render_geometry(tex, buffer.get_vertices(), indices);
+			}
+		}
+
+		/** Merges command buffers in order and submits them as one 
+		 * sorted sequence. Must be called on the thread owning the 
+		 * renderer, the buffers may have been filled on any thread.
+		 * @param buffers The command buffers, left intact.
+		 * @throws std::runtime_error on failure. */
+		void submit(std::span<const CommandBuffer> buffers) {
+			merged_commands.clear();
+			for (const auto& buffer : buffers)
+				merged_commands.append(buffer);
+			submit(merged_commands);
+		}
+
+		/** Records commands on worker threads, one CommandBuffer per task,
+		 * without locks, then merges the buffers in task order on the 
+		 * calling thread. The calling thread records task 0 itself.
+		 * In deferred mode the result joins the frame's commands, 
+		 * otherwise it's submitted right away.
+		 * @param tasks The number of buffers to record.
+		 * @param record Called as record(task, buffer) with an empty 
+		 * buffer. It must not touch the renderer.
+		 * @throws std::runtime_error on failure or the first exception 
+		 * thrown by record. */
+		template <typename F>
+		void record_parallel(std::size_t tasks, F&& record) {
+			if (!tasks)
+				return;
+			if (!recorders)
+				recorders = std::make_unique<ThreadPool>();
+			if (thread_commands.size() < tasks)
+				thread_commands.resize(tasks);
+			FrameVector<std::exception_ptr> errors(tasks, frame_arena);
+			auto run = [&](std::size_t task) {
+				try {
+					thread_commands[task].clear();
+					record(task, thread_commands[task]);
+				} catch (...) {
+					errors[task] = std::current_exception();
+				}
+			};
+			std::latch done(static_cast<std::ptrdiff_t>(tasks - 1));
+			for (std::size_t task = 1; task < tasks; task++)
+				recorders->submit([&, task]{
+					run(task);
+					done.count_down();
+				});
+			run(0);
+			done.wait();
+			for (const auto& error : errors)
+				if (error)
+					std::rethrow_exception(error);
+			auto buffers = std::span<const CommandBuffer>(thread_commands).first(tasks);
+			if (deferred) {
+				for (const auto& buffer : buffers)
+					frame_commands.append(buffer);
+			} else {
+				submit(buffers);
+			}
+		}
+
+		/** Creates a transparent layer backed by a render target texture.
+		 * @param w The width of the layer.
+		 * @param h The height of the layer.
+		 * @return The Layer, initially dirty.
+		 * @throws std::runtime_error on failure. */
+		Layer create_layer(int w, int h) {
+			Texture tex(
+				SDL_CreateTexture(
+					ren.get(), SDL_PIXELFORMAT_ARGB8888,
+					SDL_TEXTUREACCESS_TARGET, w, h),
+				[](SDL_Texture* t){
+					if (t) SDL_DestroyTexture(t);
+					SDL2_BASE_LOG_DEBUG("Layer destroyed.");
+				}
+			);
+			if (!tex)
+				throw std::runtime_error("Failed to create layer.");
+			if (SDL_SetTextureBlendMode(tex.get(), SDL_BLENDMODE_BLEND))
+				throw std::runtime_error("Failed to set blend mode.");
+			return Layer(std::move(tex), w, h);
+		}
+
+		/** Re-renders a layer if it's dirty. The dirty part is cleared to 
+		 * transparent and rendering is clipped to it. Draws inside render
+		 * go straight to the layer even in deferred mode. The render
+		 * target, clip rect and draw color are restored afterwards.
+		 * @param layer The layer.
+		 * @param render Called with the dirty rectangle in layer 
+		 * coordinates to draw the layer's content with this Base.
+		 * @return Whether the layer was re-rendered.
+		 * @throws std::runtime_error on failure or whatever render throws. */
+		template <typename F>
+		bool update_layer(Layer& layer, F&& render) {
+			if (!layer.dirty)
+				return false;
+			struct Restore {
+				Base& base;
+				SDL_Texture* target;
+				bool deferred;
+				SDL_Color col;
+				bool clipped;
+				SDL_Rect clip;
+				SDL_BlendMode blend;
+				~Restore() {
+					SDL_RenderSetClipRect(base.ren.get(), nullptr);
+					SDL_SetRenderTarget(base.ren.get(), target);
+					SDL_RenderSetClipRect(base.ren.get(), clipped ? &clip : nullptr);
+					SDL_SetRenderDrawColor(
+						base.ren.get(), col.r, col.g, col.b, col.a);
+					SDL_SetRenderDrawBlendMode(base.ren.get(), blend);
+					base.deferred = deferred;
+				}
+			} restore {
+				*this, SDL_GetRenderTarget(ren.get()), deferred, {0, 0, 0, 0},
+				SDL_RenderIsClipEnabled(ren.get()) == SDL_TRUE, {0, 0, 0, 0},
+				SDL_BLENDMODE_NONE
+			};
+			SDL_GetRenderDrawColor(
+				ren.get(), &restore.col.r, &restore.col.g,
+				&restore.col.b, &restore.col.a);
+			SDL_RenderGetClipRect(ren.get(), &restore.clip);
+			SDL_GetRenderDrawBlendMode(ren.get(), &restore.blend);
+			if (deferred)
+				submit_frame();
+			deferred = false;
+
+			SDL_Rect rect = layer.region.value_or(SDL_Rect {0, 0, layer.w, layer.h});
+			if (SDL_SetRenderTarget(ren.get(), layer.target.get()))
+				throw std::runtime_error("Failed to set render target.");
+			if (SDL_RenderSetClipRect(ren.get(), &rect))
+				throw std::runtime_error("Failed to set clip rect.");
+			// SDL_RenderClear ignores the clip rect, so only the dirty part
+			// is overwritten with transparent pixels.
+			if (SDL_SetRenderDrawBlendMode(ren.get(), SDL_BLENDMODE_NONE) ||
+				SDL_SetRenderDrawColor(ren.get(), 0, 0, 0, 0) ||
+				SDL_RenderFillRect(ren.get(), &rect) ||
+				SDL_SetRenderDrawBlendMode(ren.get(), restore.blend))
+				throw std::runtime_error("Failed to clear layer.");
+			render(rect);
+			layer.dirty = false;
+			layer.region.reset();
+			return true;
+		}
+
+		/** Composites a layer with a single texture copy.
+		 * @param layer The layer.
+		 * @param dstrect The destination or nullptr for the whole target.
+		 * @throws std::runtime_error on failure. */
+		void draw(const Layer& layer, const SDL_FRect* dstrect = nullptr) {
+			draw(TextureRenderArgsF {
+				layer.target, nullptr, const_cast<SDL_FRect*>(dstrect), 0, SDL_FLIP_NONE
+			});
+		}
+
+		/** Returns the camera. Until a viewport is set it covers the 
+		 * whole output, with world and screen coordinates equal.
+		 * @return The Camera.
+		 * @throws std::runtime_error on failure. */
+		Camera& get_camera() {
+			if (camera.get_viewport().w <= 0) {
+				int w, h;
+				if (SDL_GetRendererOutputSize(ren.get(), &w, &h))
+					throw std::runtime_error("Failed to get output size.");
+				float fw = static_cast<float>(w), fh = static_cast<float>(h);
+				camera.set_viewport({0, 0, fw, fh});
+				camera.set_center({fw / 2, fh / 2});
+			}
+			return camera;
+		}
+
+		/** Creates a StreamingTexture.
+		 * @param w The width of the texture.
+		 * @param h The height of the texture.
+		 * @param buffers The number of textures to rotate through, 
+		 * 2 or 3 avoids stalls.
+		 * @param format The pixel format.
+		 * @return The StreamingTexture.
+		 * @throws std::runtime_error on failure. */
+		StreamingTexture create_streaming_texture(
+			int w, int h,
+			std::size_t buffers = 2,
+			Uint32 format = SDL_PIXELFORMAT_ARGB8888
+		) {
+			std::vector<Texture> textures;
+			for (std::size_t i = 0; i < std::max<std::size_t>(buffers, 1); i++) {
+				textures.emplace_back(
+					SDL_CreateTexture(
+						ren.get(), format, SDL_TEXTUREACCESS_STREAMING, w, h),
+					[](SDL_Texture* t){
+						if (t) SDL_DestroyTexture(t);
+						SDL2_BASE_LOG_DEBUG("Streaming texture destroyed.");
+					}
+				);
+				if (!textures.back())
+					throw std::runtime_error("Failed to create streaming texture.");
+			}
+			return StreamingTexture(std::move(textures), w, h);
+		}
+
+		/** Returns the arena for transient data of the current frame,
+		 * reset at the end of present. Use ArenaAllocator or FrameVector
+		 * for containers, and LocalArena per worker thread.
+		 * @return The FrameArena. */
+		FrameArena& get_frame_arena() {
+			return frame_arena;
 		}
 
 		/** Returns a map of Strings and Textures associated.
-		 * Loads textures that have not been loaded before lazily.
+		 * Loads textures that have not been loaded before with preload.
 		 * @param bmps A list of bmps to return a map to.
 		 * @throws std::runtime_error on failure. */
-		auto get_textures_map(std::vector<std::string_view> bmps) {
+		auto get_textures_map(std::span<const std::string_view> bmps) {
+			auto result = preload(bmps);
 			std::map<std::string, Texture> map;
-			for (auto bmp : bmps) {
-				auto tex = get_texture(bmp);
-				map.emplace(bmp, tex);
+			for (std::size_t i = 0; i < bmps.size(); i++) {
+				map.emplace(bmps[i], get_texture(result.handles[i].index));
+				release_texture(result.handles[i]);
 			}
-			DBGMSG("String/Texture map created.");
+			SDL2_BASE_LOG_DEBUG("String/Texture map created.");
 			return map;
 		}
 
+		/** Loads many bmps at once: duplicates are loaded once, the bmps
+		 * that aren't resident yet are decoded in parallel on the loader
+		 * threads and the calling thread, then uploaded together.
+		 * Bmps with an asynchronous load in flight are left to it and 
+		 * resolve to the placeholder until present uploads them.
+		 * @param bmps Paths to the bmps.
+		 * @return The handles in the order of bmps, each of which must be
+		 * released, and what the preload cost.
+		 * @throws std::runtime_error on failure. */
+		PreloadResult preload(std::span<const std::string_view> bmps) {
+			Uint64 start = SDL_GetPerformanceCounter();
+			PreloadResult result {{}, 0, 0, 0};
+			std::vector<TextureId> ids;
+			ids.reserve(bmps.size());
+			for (auto bmp : bmps)
+				ids.push_back(textures.intern(bmp));
+			std::vector<TextureId> misses;
+			for (auto id : ids)
+				if (!textures[id].tex && !textures[id].pending)
+					misses.push_back(id);
+			std::sort(misses.begin(), misses.end());
+			misses.erase(std::unique(misses.begin(), misses.end()), misses.end());
+
+			std::vector<const std::string*> paths;
+			std::vector<Surface> surfaces;
+			for (auto id : misses)
+				if (!textures[id].archive) {
+					paths.push_back(&textures[id].path);
+					surfaces.emplace_back(nullptr, SDL_FreeSurface);
+				}
+			if (paths.size() > 1) {
+				if (!loader)
+					loader = std::make_unique<ThreadPool>();
+				std::atomic<std::size_t> next {0};
+				auto decode = [&, format = get_texture_format()]{
+					for (std::size_t i; (i = next++) < paths.size();)
+						surfaces[i] = decode_surface(*paths[i], format, load_config);
+				};
+				std::size_t helpers = std::min(loader->size(), paths.size() - 1);
+				std::latch done(static_cast<std::ptrdiff_t>(helpers));
+				for (std::size_t i = 0; i < helpers; i++)
+					loader->submit([&]{
+						decode();
+						done.count_down();
+					});
+				decode();
+				done.wait();
+			}
+
+			// Newly loaded textures are pinned until all handles are
+			// acquired, so the budget can't evict them in between.
+			auto unpin = [&]{
+				for (std::size_t i = 0; i < result.loaded; i++)
+					textures[misses[i]].handles--;
+			};
+			try {
+				std::size_t surface = 0;
+				for (auto id : misses) {
+					auto& entry = textures[id];
+					cache_stats.misses++;
+					if (entry.archive) {
+						result.bytes += store_texture(id, create_archive_texture(entry));
+					} else if (paths.size() > 1 && surfaces[surface]) {
+						result.bytes += store_texture(id, create_texture(surfaces[surface].get()));
+						surfaces[surface++].reset();
+					} else {
+						// Decoding failed or there was only one bmp to load.
+						Surface sur = load_converted_surface(entry.path, get_texture_format());
+						result.bytes += store_texture(id, create_texture(sur.get()));
+						surface++;
+					}
+					entry.handles++;
+					result.loaded++;
+				}
+			} catch (...) {
+				unpin();
+				throw;
+			}
+			// Every upload has succeeded here, but a bmp that was resident
+			// may have been evicted by them and reloading it can fail.
+			result.handles.reserve(ids.size());
+			try {
+				for (auto id : ids)
+					result.handles.push_back(acquire_texture(id));
+			} catch (...) {
+				for (auto handle : result.handles)
+					release_texture(handle);
+				unpin();
+				throw;
+			}
+			unpin();
+			result.ms = static_cast<double>(SDL_GetPerformanceCounter() - start) *
+				1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+			SDL2_BASE_LOG_DEBUG("Preloaded {} textures, {} bytes.", result.loaded, result.bytes);
+			return result;
+		}
+
 		/** Draws and fills a rectangle.
 		 * @param args Struct containing rendering arguments.
 		 * @throws std::runtime_error on failure. */
-		void draw(ColorRenderArgs args) {
+		void draw(ColorRenderArgs args) SDL2_BASE_DRAW_NOEXCEPT {
+			if (deferred) {
+				draw(std::span<const ColorRenderArgs>(&args, 1));
+				return;
+			}
+			SDL2_BASE_PROFILE_SCOPE(DRAW);
+			SDL2_BASE_PROFILE_DRAW_CALL(nullptr);
 			SDL_Rect rect = args.rect;
 			SDL_Color col = args.col;
 			if (SDL_SetRenderDrawColor(ren.get(), col.r, col.g, col.b, col.a))
-				throw std::runtime_error("Failed to set draw color.");
+				SDL2_BASE_DRAW_ERROR("Failed to set draw color.");
 			if (SDL_RenderFillRect(ren.get(), &rect))
-				throw std::runtime_error("Failed to fill rect.");
+				SDL2_BASE_DRAW_ERROR("Failed to fill rect.");
 		}
 
 		/** Draws and fills a rectangle (float).
 		 * @param args Struct containing rendering arguments.
 		 * @throws std::runtime_error on failure. */
-		void draw(ColorRenderArgsF args) {
+		void draw(ColorRenderArgsF args) SDL2_BASE_DRAW_NOEXCEPT {
+			if (deferred) {
+				SDL2_BASE_RECORD_DRAW(frame_commands.add_rect(
+					args.rect, args.col, layer, get_draw_blend_mode()));
+				return;
+			}
+			SDL2_BASE_PROFILE_SCOPE(DRAW);
+			SDL2_BASE_PROFILE_DRAW_CALL(nullptr);
 			SDL_FRect rect = args.rect;
 			SDL_Color col = args.col;
 			if (SDL_SetRenderDrawColor(ren.get(), col.r, col.g, col.b, col.a))
-				throw std::runtime_error("Failed to set draw color.");
+				SDL2_BASE_DRAW_ERROR("Failed to set draw color.");
 			if (SDL_RenderFillRectF(ren.get(), &rect))
-				throw std::runtime_error("Failed to fill rect.");
+				SDL2_BASE_DRAW_ERROR("Failed to fill rect.");
+		}
+
+		/** Draws and fills a batch of rectangles of any colors with a single
+		 * SDL_RenderGeometry call. The renderer's draw color is untouched.
+		 * @param args Rendering arguments for each rectangle.
+		 * @throws std::runtime_error on failure. */
+		void draw(std::span<const ColorRenderArgs> args) SDL2_BASE_DRAW_NOEXCEPT {
+			SDL2_BASE_PROFILE_SCOPE(DRAW);
+			auto to_float = [](const SDL_Rect& rect) {
+				return SDL_FRect {
+					static_cast<float>(rect.x),
+					static_cast<float>(rect.y),
+					static_cast<float>(rect.w),
+					static_cast<float>(rect.h)
+				};
+			};
+			if (deferred) {
+				SDL_BlendMode blend = get_draw_blend_mode();
+				SDL2_BASE_RECORD_DRAW(for (const auto& arg : args)
+					frame_commands.add_rect(to_float(arg.rect), arg.col, layer, blend));
+				return;
+			}
+			geometry.clear();
+			bool built = false;
+			SDL2_BASE_RECORD_DRAW(for (const auto& arg : args)
+				geometry.push_rect(to_float(arg.rect), arg.col);
+				built = true);
+			if (built)
+				render_geometry(nullptr, geometry);
+		}
+
+		/** Draws and fills a batch of rectangles (float) of any colors with
+		 * a single SDL_RenderGeometry call. 
+		 * The renderer's draw color is untouched.
+		 * @param args Rendering arguments for each rectangle.
+		 * @throws std::runtime_error on failure. */
+		void draw(std::span<const ColorRenderArgsF> args) SDL2_BASE_DRAW_NOEXCEPT {
+			SDL2_BASE_PROFILE_SCOPE(DRAW);
+			if (deferred) {
+				SDL_BlendMode blend = get_draw_blend_mode();
+				SDL2_BASE_RECORD_DRAW(for (const auto& arg : args)
+					frame_commands.add_rect(arg.rect, arg.col, layer, blend));
+				return;
+			}
+			geometry.clear();
+			bool built = false;
+			SDL2_BASE_RECORD_DRAW(for (const auto& arg : args)
+				geometry.push_rect(arg.rect, arg.col);
+				built = true);
+			if (built)
+				render_geometry(nullptr, geometry);
 		}
 
 		/** Draws a texture.
 		 * @param args Struct containing the rendering arguments. 
 		 * @throws std::runtime_error on failure. */
-		void draw(TextureRenderArgs args) {
+		void draw(TextureRenderArgs args) SDL2_BASE_DRAW_NOEXCEPT {
+			if (deferred) {
+				SDL_FRect dst;
+				if (args.dstrect)
+					dst = {
+						static_cast<float>(args.dstrect->x),
+						static_cast<float>(args.dstrect->y),
+						static_cast<float>(args.dstrect->w),
+						static_cast<float>(args.dstrect->h)
+					};
+				SDL2_BASE_RECORD_DRAW(record_texture(
+					args.tex, args.srcrect, args.dstrect ? &dst : nullptr,
+					args.angle, args.flip));
+				return;
+			}
+			SDL2_BASE_PROFILE_SCOPE(DRAW);
+			SDL2_BASE_PROFILE_DRAW_CALL(args.tex.get());
 			if (SDL_RenderCopyEx(
 				ren.get(), args.tex.get(), args.srcrect,
 				args.dstrect, args.angle, nullptr, args.flip)
 			)
-				throw std::runtime_error("Failed to draw texture.");
+				SDL2_BASE_DRAW_ERROR("Failed to draw texture.");
 		}
 
 		/** Draws a texture (float).
 		 * @param args Struct containing the rendering arguments. 
 		 * @throws std::runtime_error on failure. */
-		void draw(TextureRenderArgsF args) {
+		void draw(TextureRenderArgsF args) SDL2_BASE_DRAW_NOEXCEPT {
+			if (deferred) {
+				SDL2_BASE_RECORD_DRAW(record_texture(
+					args.tex, args.srcrect, args.dstrect, args.angle, args.flip));
+				return;
+			}
+			SDL2_BASE_PROFILE_SCOPE(DRAW);
+			SDL2_BASE_PROFILE_DRAW_CALL(args.tex.get());
 			if (SDL_RenderCopyExF(
 				ren.get(), args.tex.get(), args.srcrect,
 				args.dstrect, args.angle, nullptr, args.flip)
 			)
-				throw std::runtime_error("Failed to draw texture.");
+				SDL2_BASE_DRAW_ERROR("Failed to draw texture.");
+		}
+
+		/** Draws a texture through a TextureHandle.
+		 * @param args Struct containing the rendering arguments.
+		 * @throws std::runtime_error on failure or, in debug builds, on 
+		 * a stale handle. */
+		void draw(const HandleRenderArgsF& args) SDL2_BASE_DRAW_NOEXCEPT {
+			SDL_Texture* tex = resolve_draw(args.tex);
+			if (!tex)
+				return;
+			if (deferred) {
+				SDL_FRect dst {0, 0, 0, 0};
+				if (args.dstrect) {
+					dst = *args.dstrect;
+				} else {
+					int w, h;
+					if (SDL_GetRendererOutputSize(ren.get(), &w, &h)) {
+						SDL2_BASE_DRAW_ERROR("Failed to get output size.");
+						return;
+					}
+					dst = {0, 0, static_cast<float>(w), static_cast<float>(h)};
+				}
+				SDL_BlendMode blend;
+				if (SDL_GetTextureBlendMode(tex, &blend)) {
+					SDL2_BASE_DRAW_ERROR("Failed to get blend mode.");
+					return;
+				}
+				SDL2_BASE_RECORD_DRAW(frame_commands.add_sprite(
+					tex, args.srcrect, dst, args.angle, args.flip,
+					{255, 255, 255, 255}, layer, blend));
+				return;
+			}
+			SDL2_BASE_PROFILE_SCOPE(DRAW);
+			SDL2_BASE_PROFILE_DRAW_CALL(tex);
+			if (SDL_RenderCopyExF(
+				ren.get(), tex, args.srcrect,
+				args.dstrect, args.angle, nullptr, args.flip)
+			)
+				SDL2_BASE_DRAW_ERROR("Failed to draw texture.");
+		}
+
+		/** Draws sprites through TextureHandles with one 
+		 * SDL_RenderGeometry call per run of the same texture. 
+		 * Sprites without a dstrect are skipped.
+		 * @param args Rendering arguments for each sprite.
+		 * @throws std::runtime_error on failure or, in debug builds, on 
+		 * a stale handle. */
+		void draw(std::span<const HandleRenderArgsF> args) SDL2_BASE_DRAW_NOEXCEPT {
+			handle_batch.clear();
+			for (const auto& arg : args) {
+				if (!arg.dstrect)
+					continue;
+				SDL_Texture* tex = resolve_draw(arg.tex);
+				if (tex) {
+					SDL2_BASE_RECORD_DRAW(handle_batch.add(
+						tex, arg.srcrect, *arg.dstrect, arg.angle, arg.flip));
+				}
+			}
+			draw(handle_batch);
+		}
+
+		/** Draws a SpriteBatch with one SDL_RenderGeometry call per run.
+		 * The batch is left intact so static batches can be redrawn.
+		 * In deferred mode its textures have to outlive the frame.
+		 * @param batch The batch to draw.
+		 * @throws std::runtime_error on failure. */
+		void draw(const SpriteBatch& batch) SDL2_BASE_DRAW_NOEXCEPT {
+			if (deferred) {
+				SDL2_BASE_RECORD_DRAW(frame_commands.add_batch(batch, layer));
+				return;
+			}
+			SDL2_BASE_PROFILE_SCOPE(DRAW);
+			for (const auto& run : batch.get_runs())
+				render_geometry(
+					run.tex, batch.get_geometry(),
+					run.first_index, run.index_count
+				);
+		}
+
+#ifdef SDL2_BASE_RECORD_ERRORS
+		/** Returns the errors the drawing functions recorded during the
+		 * previous frame, up to and including its present. 
+		 * Only available when compiled with SDL2_BASE_RECORD_ERRORS 
+		 * defined, which makes them noexcept.
+		 * @return The DrawErrors. */
+		DrawErrors get_draw_errors() const {
+			return frame_errors;
+		}
+#endif
+
+#ifdef SDL2_BASE_PROFILE
+		/** Returns the frame profiler. Only available when compiled with
+		 * SDL2_BASE_PROFILE defined.
+		 * @return The Profiler. */
+		const Profiler& get_profiler() const {
+			return profiler;
+		}
+
+		/** Returns the renderer load of the most recent frames. Only
+		 * available when compiled with SDL2_BASE_PROFILE defined.
+		 * @param last_n The number of frames.
+		 * @return The RenderStats. */
+		RenderStats get_render_stats(std::size_t last_n = 60) const {
+			auto frames = profiler.get_frames(last_n);
+			RenderStats stats {0, 0, 0,
+				profiler.summarize_frames(last_n),
+				profiler.summarize(last_n, [](const FrameStats& frame) {
+					return frame.present_ticks;
+				})
+			};
+			for (const auto& frame : frames) {
+				stats.draw_calls += frame.draw_calls;
+				stats.vertices += frame.vertices;
+				stats.texture_switches += frame.texture_binds;
+			}
+			double n = static_cast<double>(std::max<std::size_t>(1, frames.size()));
+			stats.draw_calls /= n;
+			stats.vertices /= n;
+			stats.texture_switches /= n;
+			return stats;
+		}
+#endif
+
+		/** Runs the main loop until the state is set to QUITTING.
+		 * Each frame polls events, advances the simulation in fixed steps
+		 * and renders once. Without vsync frames are paced to 
+		 * config.max_fps by sleeping and spinning for the last 
+		 * couple of milliseconds.
+		 * @param update Called with the timestep in seconds per step.
+		 * @param render Called once per frame with the interpolation 
+		 * factor between the previous and the current step in [0, 1).
+		 * present is called after it.
+		 * @param config The loop configuration.
+		 * @throws std::runtime_error on failure or whatever update 
+		 * and render throw. */
+		template <typename Update, typename Render>
+		void run(Update&& update, Render&& render, LoopConfig config = {}) {
+			const Uint64 freq = SDL_GetPerformanceFrequency();
+			const Uint64 step = std::max<Uint64>(1,
+				static_cast<Uint64>(config.timestep * static_cast<double>(freq)));
+			const Uint64 max_lag = step * static_cast<Uint64>(std::max(1, config.max_steps));
+			SDL_RendererInfo info;
+			bool vsync = !SDL_GetRendererInfo(ren.get(), &info) &&
+				info.flags & SDL_RENDERER_PRESENTVSYNC;
+			const Uint64 frame_ticks = config.max_fps > 0 && !vsync ?
+				static_cast<Uint64>(static_cast<double>(freq) / config.max_fps) : 0;
+
+			Uint64 previous = SDL_GetPerformanceCounter();
+			Uint64 lag = 0;
+			while (state == RUNNING) {
+				Uint64 frame_begin = SDL_GetPerformanceCounter();
+				lag = std::min(lag + frame_begin - previous, max_lag);
+				previous = frame_begin;
+				poll_events();
+				for (; lag >= step && state == RUNNING; lag -= step)
+					update(config.timestep);
+				render(static_cast<double>(lag) / static_cast<double>(step));
+				present();
+				if (frame_ticks)
+					wait_until(frame_begin + frame_ticks, freq);
+			}
 		}
 
 		/** Return the current value of the inner 'state' variable.
@@ -361,12 +5639,74 @@ namespace SDL2_Base {
 			this->state = state;
 		}
 
-		/** Poll for currecntly pending events. */
-		void poll_events() {
-			while (SDL_PollEvent(&event)) {}
+		/** Registers the handler of an event type, replacing the previous
+		 * one. Events without a handler are discarded.
+		 * @param type The event type.
+		 * @param handler The handler or nullptr to remove it. 
+		 * @throws std::runtime_error if more than 255 event types 
+		 * have handlers. */
+		void on(Uint32 type, EventHandler handler) {
+			if (handler_slots.empty())
+				handler_slots.resize(SDL_LASTEVENT + 1, 0);
+			Uint8& slot = handler_slots[type & SDL_LASTEVENT];
+			if (!slot) {
+				if (handlers.size() == UINT8_MAX)
+					throw std::runtime_error("Too many event handlers.");
+				handlers.emplace_back();
+				slot = static_cast<Uint8>(handlers.size());
+			}
+			handlers[slot - 1] = std::move(handler);
+		}
+
+		/** Calls the handler registered for the type of an event.
+		 * @param e The event. */
+		void dispatch(const SDL_Event& e) {
+			if (e.type == SDL_MOUSEWHEEL)
+				input.add_wheel(e.wheel);
+			if (handler_slots.empty())
+				return;
+			Uint8 slot = handler_slots[e.type & SDL_LASTEVENT];
+			if (slot && handlers[slot - 1])
+				handlers[slot - 1](e);
+		}
+
+		/** Poll for currecntly pending events, capture the Input snapshot
+		 * and dispatch the events to the registered handlers. 
+		 * Events are drained in bulk into a reusable buffer.
+		 * @return The number of events. */
+		std::size_t poll_events() {
+			SDL2_BASE_PROFILE_SCOPE(POLL_EVENTS);
+			SDL_PumpEvents();
+			input.update();
+			std::size_t total = 0;
+			int count;
+			do {
+				count = SDL_PeepEvents(
+					event_buffer.data(), static_cast<int>(event_buffer.size()),
+					SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+				for (int i = 0; i < count; i++)
+					dispatch(event_buffer[static_cast<std::size_t>(i)]);
+				total += static_cast<std::size_t>(std::max(count, 0));
+			} while (count == static_cast<int>(event_buffer.size()));
+			return total;
+		}
+
+		/** Waits for an event for at most timeout_ms, then dispatches
+		 * it along with all other pending events. Lets idle tools sleep
+		 * instead of spinning.
+		 * @param timeout_ms The maximum time to wait in ms.
+		 * @return The number of events. */
+		std::size_t wait_events(int timeout_ms) {
+			{
+				SDL2_BASE_PROFILE_SCOPE(POLL_EVENTS);
+				// With nullptr the event is left in the queue.
+				SDL_WaitEventTimeout(nullptr, timeout_ms);
+			}
+			return poll_events();
 		}
 
-		/** Check whether the given key was pressed (case insensitive).
+		/** Check whether the given key is held down (case insensitive)
+		 * as of the last poll_events.
 		 * @return A boolean indicating the result. */
 		bool is_key_pressed(Key key) {
 			SDL_Scancode scancode;
@@ -374,9 +5714,14 @@ namespace SDL2_Base {
 				case Q:
 					scancode = SDL_SCANCODE_Q;
 			}
-			if (SDL_GetKeyboardState(nullptr)[scancode])
-				return true;
-			return false;
+			return input.is_down(scancode);
+		}
+
+		/** Returns the keyboard and mouse snapshot of the last 
+		 * poll_events.
+		 * @return The Input. */
+		const Input& get_input() const {
+			return input;
 		}
 
 	};
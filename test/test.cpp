@@ -1,6 +1,9 @@
 #include "SDL2_base.hpp"
 #include <ctest.h>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 
 using namespace SDL2_Base;
@@ -19,11 +22,358 @@ int main(void) {
 		base.load_texture(path);
 		CTEST(base.is_texture_loaded(path));
 		auto tex = base.get_texture(path);
+		auto id = base.intern_texture(path);
+		CTEST(base.get_texture(id) == tex);
+		CTEST(!base.is_texture_loaded("../assets/missing.bmp"));
+		CTEST(base.load_texture_async(path) == id);
+		CTEST(base.get_pending_loads() == 0);
+		base.load_texture_async("../assets/../assets/face.bmp");
+		CTEST(base.get_pending_loads() == 1);
+		std::size_t uploaded = 0;
+		for (int i = 0; i < 100 && !uploaded; i++) {
+			uploaded = base.process_uploads(0);
+			if (!uploaded)
+				SDL_Delay(10);
+		}
+		CTEST(uploaded == 1 && base.get_pending_loads() == 0);
+		std::vector<std::string_view> archive_paths {path};
+		Archive::pack("test_archive.sbar", archive_paths);
+		Archive archive("test_archive.sbar");
+		CTEST(archive.get_records().size() == 1);
+		CTEST(archive.get_path(archive.get_records()[0]) == path);
+		base.mount_archive("test_archive.sbar");
+		base.set_texture_budget(0);
+		CTEST(base.is_texture_loaded(path));
+		CTEST(base.get_texture_cache_stats().evictions == 0);
+		CTEST(base.get_texture_cache_stats().hits > 0);
+		base.set_texture_budget(SIZE_MAX);
+		std::vector<std::string_view> atlas_paths {path, path};
+		base.build_atlas(atlas_paths);
+		auto region = base.get_region(path);
+		CTEST(region.tex != tex);
+		CTEST(base.get_atlas_stats().pages == 1);
+		CTEST(base.get_atlas_stats().regions == 1);
 		base.load_texture(path);
 		std::vector<std::string_view> paths;
 		paths.push_back(path);
 		auto map = base.get_textures_map(paths);
 		CTEST(map.find(path)->second == tex);
+		int user_events = 0;
+		base.on(SDL_USEREVENT, [&](const SDL_Event&) { user_events++; });
+		SDL_Event user_event {};
+		user_event.type = SDL_USEREVENT;
+		SDL_PushEvent(&user_event);
+		SDL_PushEvent(&user_event);
+		base.poll_events();
+		CTEST(user_events == 2);
+		SDL_Event wheel_event {};
+		wheel_event.type = SDL_MOUSEWHEEL;
+		wheel_event.wheel.preciseY = 1.5f;
+		SDL_PushEvent(&wheel_event);
+		SDL_PushEvent(&wheel_event);
+		base.poll_events();
+		const Input& input = base.get_input();
+		CTEST(input.get_wheel().y == 3.0f && input.get_wheel().x == 0);
+		base.poll_events();
+		CTEST(input.get_wheel().y == 0);
+		// Pushed key events don't reach the keyboard state, so no key is 
+		// down in a test run.
+		KeySet keys;
+		keys.set(SDL_SCANCODE_A);
+		CTEST(!input.was_pressed(SDL_SCANCODE_A) && !input.was_released(SDL_SCANCODE_A));
+		CTEST(!input.any_down(keys) && !input.all_down(keys));
+		CTEST(input.all_down(KeySet()) && input.get_pressed().none());
+		CommandBuffer commands;
+		commands.add_rect({0, 0, 10, 10}, {255, 0, 0, 255}, 1);
+		commands.add_sprite(tex.get(), nullptr, {0, 0, 10, 10});
+		CTEST(!commands.is_sorted());
+		base.submit(commands);
+		CTEST(commands.is_sorted());
+		CTEST(commands.get_texture(commands.get_commands()[0].key) == tex.get());
+		CommandBuffer merged;
+		merged.append(commands);
+		merged.append(commands);
+		CTEST(merged.get_commands().size() == 4);
+		base.record_parallel(4, [&](std::size_t task, CommandBuffer& buffer) {
+			buffer.add_sprite(
+				tex.get(), nullptr, {static_cast<float>(task) * 10, 0, 10, 10});
+		});
+		ColorRenderArgs color_rects[] {
+			{{0, 0, 4, 4}, {255, 0, 0, 255}}, {{4, 0, 4, 4}, {0, 0, 255, 255}}
+		};
+		ColorRenderArgsF color_rects_f[] {
+			{{0, 4, 4, 4}, {255, 0, 0, 255}}, {{4, 4, 4, 4}, {0, 0, 255, 255}}
+		};
+		bool drew_rects = false;
+		try {
+			base.draw(std::span<const ColorRenderArgs>(color_rects));
+			base.draw(std::span<const ColorRenderArgsF>(color_rects_f));
+			base.set_deferred(true);
+			base.draw(std::span<const ColorRenderArgs>(color_rects));
+			base.draw(std::span<const ColorRenderArgsF>(color_rects_f));
+			base.set_deferred(false);
+			drew_rects = true;
+		} catch (const std::runtime_error&) {}
+		CTEST(drew_rects);
+		{
+			FrameVector<int> scratch(base.get_frame_arena());
+			scratch.push_back(1);
+			CTEST(base.get_frame_arena().get_used() >= sizeof(int));
+		}
+		base.present();
+		CTEST(base.get_frame_arena().get_used() == 0);
+		auto layer = base.create_layer(64, 64);
+		auto draw_layer = [&](SDL_Rect rect) {
+			base.draw(ColorRenderArgs {rect, {0, 255, 0, 255}});
+		};
+		CTEST(base.update_layer(layer, draw_layer));
+		CTEST(!base.update_layer(layer, draw_layer));
+		layer.mark_dirty({0, 0, 8, 8});
+		SDL_Rect user_clip {1, 2, 30, 40};
+		base.set_clip_rect(&user_clip);
+		CTEST(base.update_layer(layer, draw_layer));
+		auto restored_clip = base.get_clip_rect();
+		CTEST(restored_clip && restored_clip->x == 1 && restored_clip->h == 40);
+		base.set_clip_rect(nullptr);
+		CTEST(!base.get_clip_rect());
+		base.draw(layer);
+
+		Uint8 bgr[] {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18};
+		Uint32 argb[6];
+		PixelConverter::bgr24_to_argb8888(bgr, argb, 6);
+		CTEST(argb[0] == 0xFF030201 && argb[5] == 0xFF121110);
+		PixelConverter::color_key_to_alpha(argb, 6, 0x060504);
+		CTEST(argb[1] == 0x00060504 && argb[2] == 0xFF090807);
+		Uint32 half = 0x80FF4000;
+		PixelConverter::premultiply_alpha(&half, 1);
+		CTEST(half == 0x80802000);
+
+		std::vector<std::string> logged;
+		Logger::get().set_sink([&](LogLevel, std::string_view message){
+			logged.emplace_back(message);
+		});
+		static LogSite site {LOG_INFO};
+		for (int i = 0; i < 20; i++)
+			Logger::get().log(site, "{} of {}", i, std::string_view(path));
+		Logger::get().flush();
+		Logger::get().set_sink(nullptr);
+		CTEST(logged.size() == Logger::rate_limit);
+		CTEST(logged.front() == std::string("0 of ") + path);
+
+		SpatialGrid<int> grid(64);
+		auto near = grid.insert({10, 10, 100, 100}, 1);
+		auto far = grid.insert({5000, 5000, 10, 10}, 2);
+		Camera& camera = base.get_camera();
+		CTEST(camera.is_visible(grid.get_bounds(near)));
+		CTEST(grid.query(camera.get_view()).size() == 1);
+		grid.move(far, {20, 20, 10, 10});
+		CTEST(grid.query(camera.get_view()).size() == 2);
+		grid.remove(near);
+		CTEST(grid.query(camera.get_view()).size() == 1);
+		CTEST(grid.get(grid.query(camera.get_view())[0]) == 2);
+
+		CTEST(std::hash<CoordinatesF>()({0.0f, 1.0f}) ==
+			std::hash<CoordinatesF>()({-0.0f, 1.0f}));
+		ChunkedGrid<Uint8, float> tiles;
+		tiles.get<0>({-1, 40}) = 7;
+		CTEST(tiles.get_chunks().size() == 1);
+		CTEST(*tiles.find<0>({-1, 40}) == 7 && *tiles.find<1>({-1, 40}) == 0);
+		CTEST(!tiles.find<0>({0, 40}));
+		int visited = 0;
+		tiles.for_each({-2, 39, 4, 2}, [&](Coordinates, Uint8& solid, float&) {
+			visited += solid == 7;
+		});
+		CTEST(visited == 1);
+
+		static_assert(std::is_trivially_copyable_v<HandleRenderArgsF>);
+		TextureHandle handle = base.acquire_texture(path);
+		CTEST(base.resolve(handle) == tex.get());
+		SDL_FRect handle_dst {0, 0, 16, 16};
+		HandleRenderArgsF handle_args[] {
+			{handle, nullptr, &handle_dst, 0, SDL_FLIP_NONE},
+			{handle, nullptr, &handle_dst, 90, SDL_FLIP_NONE}
+		};
+		base.draw(handle_args[0]);
+		base.draw(std::span<const HandleRenderArgsF>(handle_args));
+		base.release_texture(handle);
+#ifdef SDL2_BASE_RECORD_ERRORS
+		base.present();
+		CTEST(base.get_draw_errors().count == 0);
+		base.draw(TextureRenderArgsF {Texture(), nullptr, &handle_dst, 0, SDL_FLIP_NONE});
+		CTEST(base.get_draw_errors().count == 0);
+#ifndef NDEBUG
+		base.draw(handle_args[0]);
+#endif
+		base.present();
+		CTEST(base.get_draw_errors().count > 0 && base.get_draw_errors().last);
+#ifndef NDEBUG
+		CTEST(base.get_draw_errors().count == 2 &&
+			std::string_view(base.get_draw_errors().last) == "Stale texture handle.");
+#endif
+		base.present();
+		CTEST(base.get_draw_errors().count == 0);
+#endif
+
+		ParticleSystem particles;
+		for (int i = 0; i < 10; i++)
+			particles.emit({{0, 0}, {10, 0}, {2, 2}, {255, 255, 255, 255}, i < 5 ? 4.0f : 1.0f});
+		particles.update(0.5f);
+		CTEST(particles.size() == 5);
+		SpriteBatch particle_batch;
+		particles.write(particle_batch, tex.get());
+		CTEST(particle_batch.get_geometry().vertices.size() == 20);
+		CTEST(particle_batch.get_geometry().vertices[0].position.x == 4);
+		base.draw(particle_batch);
+		particles.set_limit(particles.size());
+		particles.emit({{0, 0}, {0, 0}, {2, 2}, {255, 255, 255, 255}, 1.0f});
+		CTEST(particles.size() == 5);
+
+		QualityController quality({.budget_ms = 10, .window = 20});
+		for (int i = 0; i < 20; i++)
+			quality.add_frame(i ? 5 : 20);
+		CTEST(quality.get_quality() == 1);
+		for (int i = 0; i < 20; i++)
+			quality.add_frame(20);
+		CTEST(quality.get_quality() < 1 && quality.get_p95() == 20);
+		base.start_adaptive_quality();
+		CTEST(base.get_quality() == 1 && base.get_quality_controller());
+		base.stop_adaptive_quality();
+		CTEST(!base.get_quality_controller());
+
+		std::string_view preload_paths[] {
+			"../assets/./face.bmp", path, "../assets/./face.bmp", "./../assets/face.bmp"
+		};
+		auto preloaded = base.preload(preload_paths);
+		CTEST(preloaded.handles.size() == 4 && preloaded.loaded == 2);
+		CTEST(preloaded.bytes == 2 * 16 * 16 * 4);
+		CTEST(preloaded.handles[0].index == preloaded.handles[2].index);
+		CTEST(base.resolve(preloaded.handles[1]) == tex.get());
+		for (auto preloaded_handle : preloaded.handles)
+			base.release_texture(preloaded_handle);
+
+		Font font = base.load_font(path, 8, 8, 'A');
+		CTEST(font.get_sheet().tex == region.tex);
+		SpriteBatch text_batch;
+		font.add(text_batch, "AB\nE C", {10, 10});
+		font.add(text_batch, "AB\nE C", {10, 40}, 2);
+		CTEST(text_batch.get_geometry().vertices.size() == 24);
+		CTEST(text_batch.get_geometry().vertices[0].position.x == 10);
+		CTEST(font.measure("AB\nE C").x == 32 && font.measure("AB\nE C").y == 16);
+		base.draw(text_batch);
+
+#ifdef SDL2_BASE_HAS_INOTIFY
+		auto copy_face = [&]{
+			std::ifstream in(path, std::ios::binary);
+			std::ofstream("test_reload.bmp", std::ios::binary) << in.rdbuf();
+		};
+		copy_face();
+		auto reload_tex = base.get_texture("test_reload.bmp");
+		base.watch_textures();
+		copy_face();
+		for (int i = 0; i < 100 && !base.get_texture_cache_stats().reloads; i++) {
+			SDL_Delay(10);
+			base.present();
+		}
+		CTEST(base.get_texture_cache_stats().reloads == 1);
+		CTEST(base.get_texture("test_reload.bmp") == reload_tex);
+		base.unwatch_textures();
+#endif
+
+		auto stream = base.create_streaming_texture(16, 16, 2);
+		Texture shown = stream.get_texture();
+		{
+			auto pixels = stream.lock();
+			for (int y = 0; y < 16; y++)
+				std::fill_n(pixels.row(y), 16, 0xff00ff00);
+		}
+		CTEST(stream.get_texture() != shown);
+		SDL_Rect part {0, 0, 4, 4};
+		Uint32 block[16] {};
+		shown = stream.get_texture();
+		stream.update(&part, block, 4 * sizeof(Uint32));
+		CTEST(stream.get_texture() == shown);
+		int frames = 0;
+		base.run(
+			[](double) {},
+			[&](double alpha) {
+				CTEST(alpha >= 0 && alpha < 1);
+				if (++frames == 3)
+					base.set_state(QUITTING);
+			}
+		);
+		CTEST(frames == 3);
+
+		{
+			Base offscreen(HEADLESS, 32, 16);
+			CTEST(offscreen.is_headless() && !base.is_headless());
+			offscreen.set_draw_color({255, 0, 0, 255});
+			offscreen.clear();
+			offscreen.present();
+			std::vector<Uint8> pixels(32 * 16 * 4);
+			offscreen.read_pixels(pixels, 32 * 4);
+			Uint32 first;
+			std::memcpy(&first, pixels.data(), sizeof(first));
+			CTEST(first == 0xFFFF0000);
+			CTEST(offscreen.save_bmp_async("test_headless.bmp").get());
+			auto offscreen_layer = offscreen.create_layer(32, 16);
+			offscreen.update_layer(offscreen_layer, [&](SDL_Rect rect) {
+				offscreen.draw(ColorRenderArgs {rect, {0, 255, 0, 255}});
+			});
+			offscreen_layer.mark_dirty({0, 0, 8, 8});
+			CTEST(offscreen.update_layer(offscreen_layer, [](SDL_Rect) {}));
+			offscreen.set_draw_color({0, 0, 0, 255});
+			offscreen.clear();
+			offscreen.draw(offscreen_layer);
+			offscreen.present();
+			offscreen.read_pixels(pixels, 32 * 4);
+			Uint32 cleared, kept;
+			std::memcpy(&cleared, pixels.data() + (32 + 1) * 4, sizeof(cleared));
+			std::memcpy(&kept, pixels.data() + (10 * 32 + 20) * 4, sizeof(kept));
+			CTEST(cleared == 0xFF000000 && kept == 0xFF00FF00);
+			offscreen.set_draw_color({255, 0, 0, 255});
+#ifdef SDL2_BASE_PROFILE
+			SDL_FRect profiled_dst {0, 0, 8, 8};
+			for (int i = 0; i < 5; i++) {
+				offscreen.clear();
+				offscreen.draw(ColorRenderArgs {{0, 0, 4, 4}, {0, 0, 255, 255}});
+				offscreen.draw(offscreen_layer, &profiled_dst);
+				offscreen.present();
+			}
+			const Profiler& profiler = offscreen.get_profiler();
+			auto profiled = profiler.get_frames(5);
+			CTEST(profiler.get_frame_count() >= 5 && profiled.size() == 5);
+			CTEST(profiled.back().draw_calls == 2 && profiled.back().texture_binds == 1);
+			CTEST(profiled.back().phase_start[PRESENT] != 0);
+			Summary frame_ms = profiler.summarize_frames(5);
+			CTEST(frame_ms.min > 0 && frame_ms.min <= frame_ms.avg && frame_ms.avg <= frame_ms.p99);
+			std::ostringstream trace;
+			profiler.write_chrome_trace(trace, 5);
+			std::string json = trace.str();
+			std::size_t frame_events = 0;
+			for (auto at = json.find("\"name\":\"frame\""); at != std::string::npos;
+				at = json.find("\"name\":\"frame\"", at + 1))
+				frame_events++;
+			CTEST(json.rfind("{\"traceEvents\":[{", 0) == 0 && json.ends_with("]}\n"));
+			CTEST(frame_events == 5 && json.find("\"name\":\"present\"") != std::string::npos);
+			RenderStats render_stats = offscreen.get_render_stats(5);
+			CTEST(render_stats.draw_calls == 2 && render_stats.texture_switches == 1);
+			CTEST(render_stats.frame.avg > 0 && render_stats.present.avg > 0);
+#endif
+			std::atomic<int> captured {0};
+			std::atomic<bool> red {true};
+			offscreen.start_capture([&](const CapturedFrame& frame) {
+				Uint32 pixel;
+				std::memcpy(&pixel, frame.pixels.data(), sizeof(pixel));
+				red = red && pixel == 0xFFFF0000;
+				captured++;
+			}, 2, 1);
+			for (int i = 0; i < 3; i++) {
+				offscreen.clear();
+				offscreen.present();
+			}
+			offscreen.stop_capture();
+			CTEST(captured == 3 && red);
+		}
 	} catch (const std::runtime_error& e) {
 		std::cerr << e.what() << "\n";
 	}
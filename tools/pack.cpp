@@ -0,0 +1,20 @@
+#include "SDL2_base.hpp"
+#include <iostream>
+#include <stdexcept>
+
+using namespace SDL2_Base;
+
+int main(int argc, char* argv[]) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <archive> <bmp>...\n";
+		return 1;
+	}
+	try {
+		std::vector<std::string_view> bmps(argv + 2, argv + argc);
+		Archive::pack(argv[1], bmps);
+	} catch (const std::runtime_error& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}